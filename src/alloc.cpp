@@ -0,0 +1,219 @@
+#include "alloc.hpp"
+#include <iomanip>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace ptv {
+
+#define HUGE_PAGE_BYTES (2 << 20)
+
+PoolAllocator::PoolAllocator(size_t max_idle) : max_idle_(max_idle) {}
+
+PoolAllocator &PoolAllocator::get() {
+    static PoolAllocator *pool = new PoolAllocator((size_t)POOL_MAX_IDLE_MB << 20);
+    return *pool;
+}
+
+void PoolAllocator::install() {
+    cv::Mat::setDefaultAllocator(&get());
+}
+
+void PoolAllocator::keep(size_t bytes) {
+    if (bytes < POOL_MIN_BYTES) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    kept_[size_class(bytes)]++;
+}
+
+void PoolAllocator::forget(size_t bytes) {
+    if (bytes < POOL_MIN_BYTES) {
+        return;
+    }
+    size_t cls = size_class(bytes);
+    std::vector<void *> blocks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = kept_.find(cls);
+        if (it == kept_.end() || --it->second > 0) {
+            return;
+        }
+        kept_.erase(it);
+        auto idle = idle_.find(cls);
+        if (idle != idle_.end()) {
+            blocks.swap(idle->second);
+            idle_.erase(idle);
+            idle_bytes_ -= blocks.size() * cls;
+        }
+    }
+    for (void *block : blocks) {
+        free_block(block, cls);
+    }
+}
+
+void PoolAllocator::set_max_idle(size_t max_idle) {
+    std::vector<std::pair<void *, size_t>> blocks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_idle_ = max_idle;
+        for (auto &[cls, idle] : idle_) {
+            while (idle_bytes_ > max_idle_ && !idle.empty()) {
+                blocks.emplace_back(idle.back(), cls);
+                idle.pop_back();
+                idle_bytes_ -= cls;
+            }
+        }
+    }
+    for (auto &[block, cls] : blocks) {
+        free_block(block, cls);
+    }
+}
+
+size_t PoolAllocator::size_class(size_t size) {
+    size_t unit = size >= POOL_HUGE_BYTES ? HUGE_PAGE_BYTES : 4096;
+    return (size + unit - 1) / unit * unit;
+}
+
+void *PoolAllocator::alloc_block(size_t cls) {
+#ifdef __linux__
+    if (cls >= POOL_HUGE_BYTES) {
+        // maps one huge page more and trims it, so the block is 2MB aligned
+        size_t len = cls + HUGE_PAGE_BYTES;
+        void *map = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            return nullptr;
+        }
+        uintptr_t start = (uintptr_t)map;
+        uintptr_t aligned = (start + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+        if (aligned > start) {
+            munmap(map, aligned - start);
+        }
+        size_t tail = start + len - (aligned + cls);
+        if (tail > 0) {
+            munmap((void *)(aligned + cls), tail);
+        }
+        madvise((void *)aligned, cls, MADV_HUGEPAGE);
+        return (void *)aligned;
+    }
+#endif
+    return cv::fastMalloc(cls);
+}
+
+void PoolAllocator::free_block(void *block, size_t cls) {
+#ifdef __linux__
+    if (cls >= POOL_HUGE_BYTES) {
+        munmap(block, cls);
+        return;
+    }
+#endif
+    cv::fastFree(block);
+}
+
+// same layout as OpenCV's own allocator, only where the bytes come from differs
+cv::UMatData *PoolAllocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                                      cv::AccessFlag, cv::UMatUsageFlags) const {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step != nullptr) {
+            if (data != nullptr && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData *u = new cv::UMatData(this);
+    u->size = total;
+    if (data != nullptr) {
+        u->data = u->origdata = (uchar *)data;
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+    if (total < POOL_MIN_BYTES) {
+        u->data = u->origdata = (uchar *)cv::fastMalloc(total);
+        return u;
+    }
+
+    size_t cls = size_class(total);
+    void *block = nullptr;
+    bool kept = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        kept = kept_.count(cls) > 0;
+        auto it = idle_.find(cls);
+        if (it != idle_.end() && !it->second.empty()) {
+            block = it->second.back();
+            it->second.pop_back();
+            idle_bytes_ -= cls;
+        }
+    }
+    if (block != nullptr) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (kept) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+        }
+        block = alloc_block(cls);
+        if (block == nullptr) {
+            delete u;
+            CV_Error(cv::Error::StsNoMem, "Failed to allocate " + std::to_string(cls) + " bytes");
+        }
+    }
+    u->data = u->origdata = (uchar *)block;
+    return u;
+}
+
+bool PoolAllocator::allocate(cv::UMatData *u, cv::AccessFlag, cv::UMatUsageFlags) const {
+    return u != nullptr;
+}
+
+void PoolAllocator::deallocate(cv::UMatData *u) const {
+    if (u == nullptr) {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        if (u->size < POOL_MIN_BYTES) {
+            cv::fastFree(u->origdata);
+        } else {
+            size_t cls = size_class(u->size);
+            bool keep = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (kept_.count(cls) > 0 && idle_bytes_ + cls <= max_idle_) {
+                    idle_[cls].push_back(u->origdata);
+                    idle_bytes_ += cls;
+                    keep = true;
+                }
+            }
+            if (!keep) {
+                free_block(u->origdata, cls);
+            }
+        }
+        u->origdata = nullptr;
+    }
+    delete u;
+}
+
+size_t PoolAllocator::idle_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_bytes_;
+}
+
+void PoolAllocator::report(std::ostream &out) const {
+    uint64_t total = hits() + misses();
+    // only pooled sizes are counted, other buffers always go to the system
+    out << "Allocator: " << hits() << " hits, " << misses() << " misses on pooled sizes";
+    if (total > 0) {
+        out << " (" << std::fixed << std::setprecision(1) << 100.0 * hits() / total << "% reused)";
+    }
+    out << ", " << std::fixed << std::setprecision(3) << idle_bytes() / (double)(1 << 20) << "MB idle" << std::endl;
+}
+
+}
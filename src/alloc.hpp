@@ -0,0 +1,95 @@
+#ifndef PTV_ALLOC_HPP
+#define PTV_ALLOC_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "opencv.hpp"
+
+namespace ptv {
+
+#define POOL_MIN_BYTES (64 << 10)   // smaller buffers go straight to malloc
+#define POOL_HUGE_BYTES (4 << 20)   // from here on, blocks are huge page backed
+#define POOL_MAX_IDLE_MB 512        // idle cap without --memory, a quarter of it with
+
+// Buffer pool behind every cv::Mat once install()ed.
+//
+// Frames and the scroll strip come in a handful of sizes that repeat for
+// the whole run. Running jobs keep() those sizes, and released buffers of
+// a kept size class are handed out again instead of going back to malloc.
+// Every other buffer (pages of varying length, one-off temporaries) goes
+// straight back to the system, so what stays idle does not grow with the
+// variety of page sizes.
+//
+// Classes are rounded up to 4KB, and to 2MB from POOL_HUGE_BYTES on (4K
+// frames). Those are mmap()ed 2MB aligned and marked for transparent huge
+// pages, so writing a frame does not walk thousands of 4KB pages. At most
+// `max_idle` bytes are kept idle, the rest is freed. Thread-safe.
+class PoolAllocator : public cv::MatAllocator {
+    size_t max_idle_;
+    mutable std::mutex mutex_;
+    mutable std::map<size_t, std::vector<void *>> idle_; // by size class
+    std::map<size_t, int> kept_;                          // size class -> jobs keeping it
+    mutable size_t idle_bytes_ = 0;
+    mutable std::atomic<uint64_t> hits_{0};
+    mutable std::atomic<uint64_t> misses_{0};
+
+    static size_t size_class(size_t size);
+    static void *alloc_block(size_t cls);
+    static void free_block(void *block, size_t cls);
+
+    public:
+        PoolAllocator(size_t max_idle);
+
+        // the process wide pool, never destroyed: Mats may outlive main()
+        static PoolAllocator &get();
+
+        // makes get() the allocator of every cv::Mat created from now on
+        static void install();
+
+        // blocks of `bytes` are pooled until as many forget(bytes) calls,
+        // then the class's idle blocks are freed
+        void keep(size_t bytes);
+        void forget(size_t bytes);
+
+        // frees idle blocks past the new cap (--memory)
+        void set_max_idle(size_t max_idle);
+
+        cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                               cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+        bool allocate(cv::UMatData *u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override;
+        void deallocate(cv::UMatData *u) const override;
+
+        // allocations of pooled sizes served from an idle block / that the pool could not serve
+        uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+        uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+        size_t idle_bytes() const;
+
+        void report(std::ostream &out) const;
+};
+
+// keeps `sizes` pooled for as long as it lives, one per job
+class PooledSizes {
+    std::vector<size_t> sizes_;
+
+    public:
+        PooledSizes(const std::vector<size_t> &sizes) : sizes_(sizes) {
+            for (size_t bytes : sizes_) {
+                PoolAllocator::get().keep(bytes);
+            }
+        }
+        ~PooledSizes() {
+            for (size_t bytes : sizes_) {
+                PoolAllocator::get().forget(bytes);
+            }
+        }
+        PooledSizes(const PooledSizes &) = delete;
+        PooledSizes &operator=(const PooledSizes &) = delete;
+};
+
+}
+#endif
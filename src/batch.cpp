@@ -0,0 +1,174 @@
+#include "batch.hpp"
+#include "pipeline.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace ptv {
+
+struct Job {
+    size_t line = 0;
+    std::vector<std::string> args;
+};
+
+std::vector<std::string> split_args(const std::string &line) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool quoted = false;
+    bool in_arg = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            in_arg = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if (in_arg) {
+                args.push_back(arg);
+                arg.clear();
+                in_arg = false;
+            }
+        } else {
+            arg.push_back(c);
+            in_arg = true;
+        }
+    }
+    if (in_arg) {
+        args.push_back(arg);
+    }
+    return args;
+}
+
+// The render threads, the page cache and the stage timings are shared by
+// every job, so their options are errors in a manifest line instead of
+// being ignored.
+void check_job_args(Config &conf) {
+    for (const std::string &arg : conf.get_options()) {
+        if (arg == "--cache" || arg == "--cache-size" || arg == "-j") {
+            throw ConfigError("<!> Error: '" + arg + "' applies to the whole batch, pass it next to --batch instead.");
+        } else if (arg == "--stats" || arg == "--trace") {
+            throw ConfigError("<!> Error: '" + arg + "' is not available in batch jobs, the timings of jobs running at once would mix.");
+        }
+    }
+}
+
+// escapes a string for a JSON value
+std::string json_string(const std::string &str) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c == '\n') {
+            out << "\\n";
+        } else if ((unsigned char)c < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+int run_batch(int argc, char **argv) {
+    std::string manifest = "";
+    int jobs = 2;
+    int threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+    std::string cache_dir = "";
+    int cache_mb = DEFAULT_CACHE_MB;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = std::string(argv[i]);
+            if (arg == "-h" || arg == "--help") {
+                std::cout << BATCH_HELP_TXT << std::endl;
+                return 1;
+            } else if (i + 1 >= argc) {
+                std::cerr << "<!> Missing value for '" << arg << "'." << std::endl;
+                return 1;
+            } else if (arg == "--batch") {
+                manifest = argv[++i];
+            } else if (arg == "--jobs") {
+                jobs = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "-j") {
+                threads = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--cache") {
+                cache_dir = argv[++i];
+            } else if (arg == "--cache-size") {
+                cache_mb = std::max(1, std::stoi(argv[++i]));
+            } else {
+                std::cerr << "<!> Unknown argument detected: " << arg << std::endl;
+                return 1;
+            }
+        }
+    } catch (const std::logic_error &e) {
+        std::cerr << "<!> Error: Invalid number in batch options." << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(manifest);
+    if (!file) {
+        std::cerr << "<!> Error: Could not read manifest '" << manifest << "'." << std::endl;
+        return 1;
+    }
+    std::vector<Job> queue;
+    std::string line;
+    for (size_t n = 1; std::getline(file, line); n++) {
+        std::vector<std::string> args = split_args(line);
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+        queue.push_back(Job{n, args});
+    }
+
+    // every job renders on the same pool and reads the same cache
+    ThreadPool pool(threads);
+    std::unique_ptr<PageCache> cache;
+    if (cache_dir != "") {
+        cache = std::make_unique<PageCache>(cache_dir, (uintmax_t)cache_mb << 20);
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failed{0};
+    std::mutex print;
+    auto worker = [&] {
+        for (size_t i = next++; i < queue.size(); i = next++) {
+            const Job &job = queue[i];
+            JobResult result;
+            std::string output = "";
+            try {
+                Config conf(job.args);
+                check_job_args(conf);
+                conf.set_cache_dir(cache_dir);
+                output = conf.get_output();
+                result = run_job(conf, pool, cache.get());
+            } catch (const std::exception &e) {
+                result.error = e.what();
+            }
+            if (!result.ok) {
+                failed++;
+            }
+
+            std::lock_guard<std::mutex> lock(print);
+            std::cout << "{\"line\": " << job.line << ", \"ok\": " << (result.ok ? "true" : "false")
+                      << ", \"output\": " << json_string(output) << ", \"seconds\": " << result.seconds;
+            if (!result.ok) {
+                std::cout << ", \"error\": " << json_string(result.error);
+            }
+            std::cout << "}" << std::endl;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    return failed > 0 ? 1 : 0;
+}
+
+}
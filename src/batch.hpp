@@ -0,0 +1,33 @@
+#ifndef PTV_BATCH_HPP
+#define PTV_BATCH_HPP
+
+#include <string>
+#include <vector>
+
+namespace ptv {
+
+class Config;
+
+#define BATCH_HELP_TXT "\
+ptv --batch <manifest> [options...]\n\
+Runs every job in <manifest> in this process. One job per line, written as the\n\
+same arguments ptv takes on the command line. Empty lines and lines starting\n\
+with '#' are skipped, \"double quotes\" keep spaces in a path.\n\
+   --jobs <int>                           :  jobs converted at the same time, default: 2\n\
+   -j <int>                               :  render threads shared by every job, default: number of cores\n\
+   --cache <dir>                          :  page cache and sequence indexes shared by every job.\n\
+   --cache-size <int>                     :  max size of the page cache in MB, default: 1024\n\
+Results are printed as one JSON object per job (JSON lines).\n\
+"
+
+// splits a manifest line into arguments
+std::vector<std::string> split_args(const std::string &line);
+
+// throws ConfigError for options that belong to the whole batch (-j, --cache...)
+void check_job_args(Config &conf);
+
+// `ptv --batch ...`, returns the process exit code (0 if every job succeeded)
+int run_batch(int argc, char **argv);
+
+}
+#endif
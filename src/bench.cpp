@@ -0,0 +1,538 @@
+#include "pipeline.hpp"
+#include "alloc.hpp"
+#include "compositor.hpp"
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define BENCH_HELP_TXT "\
+ptv-bench [options...]\n\
+Benchmarks each pipeline stage on a generated corpus and prints JSON.\n\
+   -h, --help                             :  show this help text.\n\
+   -n <int>                               :  pages / images in the corpus, default: 50\n\
+   -r <int>x<int>                         :  output resolution, default: 1280x720\n\
+   -p <int>x<int>                         :  pdf page size in points, default: 612x792 (letter)\n\
+   -i <int>x<int>                         :  image sequence size in pixels, default: 1920x1080\n\
+   -c [text|shapes|noise]                 :  page content, default: text\n\
+   -e [png|jpg]                           :  image sequence format, default: png\n\
+   -j <int>                               :  render threads, default: number of cores\n\
+   -k <codec>                             :  codec for the encode stage, default: h264\n\
+   -w <dir>                               :  corpus directory, default: temp directory\n\
+   -o <file>                              :  write JSON to a file instead of stdout\n\
+"
+
+struct BenchOptions {
+    int pages = 50;
+    cv::Size resolution = cv::Size(1280, 720);
+    cv::Size page_size = cv::Size(612, 792);
+    cv::Size image_size = cv::Size(1920, 1080);
+    std::string content = "text";
+    std::string image_ext = ".png";
+    int threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+    std::string codec = H264;
+    std::string work_dir = "";
+    std::string output = "";
+};
+
+// One measured stage. `unit` is what was processed (pages or frames).
+struct StageResult {
+    std::string name;
+    std::string unit;
+    size_t count = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+    double first_seconds = -1; // streaming: time to the first fragment
+};
+
+// Counts what it is given instead of encoding, isolates composition.
+class NullEncoder : public ptv::Encoder {
+    public:
+        size_t frames = 0;
+        size_t bytes = 0;
+        bool is_opened() override { return true; }
+        void write(const cv::Mat &frame) override {
+            frames++;
+            bytes += frame.total() * frame.elemSize();
+        }
+        void write_i420(const cv::Mat &yuv) override { write(yuv); }
+        void hold(int64_t held) override { frames += held; }
+        void release() override {}
+};
+
+// ====== //
+// Corpus //
+// ====== //
+
+cv::Size parse_size(const std::string &arg) {
+    size_t x = arg.find('x');
+    if (x == std::string::npos) {
+        std::cerr << "<!> Error: '" << arg << "' is not a valid size. Correct: 1920x1080" << std::endl;
+        exit(1);
+    }
+    return cv::Size(std::stoi(arg.substr(0, x)), std::stoi(arg.substr(x + 1)));
+}
+
+// pdf page content stream in the requested style
+std::string pdf_page_content(const BenchOptions &opts, int pg, std::mt19937 &rng) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int w = opts.page_size.width;
+    int h = opts.page_size.height;
+    if (opts.content == "text") {
+        out << "BT /F1 11 Tf 14 TL 40 " << h - 50 << " Td\n";
+        out << "(Page " << pg + 1 << ") Tj\n";
+        for (int line = 0; line < (h - 80) / 14; line++) {
+            out << "(The quick brown fox jumps over the lazy dog " << line << " " << pg << ") '\n";
+        }
+        out << "ET\n";
+    } else {
+        int shapes = opts.content == "noise" ? 2000 : 40;
+        float max_side = opts.content == "noise" ? 8.0f : 200.0f;
+        for (int i = 0; i < shapes; i++) {
+            out << unit(rng) << " " << unit(rng) << " " << unit(rng) << " rg ";
+            out << unit(rng) * w << " " << unit(rng) * h << " " << unit(rng) * max_side << " " << unit(rng) * max_side << " re f\n";
+        }
+    }
+    return out.str();
+}
+
+// writes a minimal pdf (catalog, page tree, one font, one content stream per page)
+void write_pdf(const std::string &path, const BenchOptions &opts) {
+    std::mt19937 rng(1);
+    std::ostringstream pdf;
+    std::vector<size_t> offsets;
+    auto begin_obj = [&]() {
+        offsets.push_back(pdf.tellp());
+        pdf << offsets.size() << " 0 obj\n";
+    };
+
+    pdf << "%PDF-1.4\n";
+    begin_obj(); // 1
+    pdf << "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+    begin_obj(); // 2
+    pdf << "<< /Type /Pages /Count " << opts.pages << " /Kids [";
+    for (int pg = 0; pg < opts.pages; pg++) {
+        pdf << " " << 4 + 2 * pg << " 0 R";
+    }
+    pdf << " ] >>\nendobj\n";
+    begin_obj(); // 3
+    pdf << "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n";
+    for (int pg = 0; pg < opts.pages; pg++) {
+        begin_obj(); // page
+        pdf << "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 " << opts.page_size.width << " " << opts.page_size.height << "]";
+        pdf << " /Resources << /Font << /F1 3 0 R >> >> /Contents " << 5 + 2 * pg << " 0 R >>\nendobj\n";
+        std::string content = pdf_page_content(opts, pg, rng);
+        begin_obj(); // contents
+        pdf << "<< /Length " << content.size() << " >>\nstream\n" << content << "\nendstream\nendobj\n";
+    }
+
+    size_t xref = pdf.tellp();
+    pdf << "xref\n0 " << offsets.size() + 1 << "\n0000000000 65535 f \n";
+    for (size_t offset : offsets) {
+        char entry[32];
+        std::snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offset);
+        pdf << entry;
+    }
+    pdf << "trailer\n<< /Size " << offsets.size() + 1 << " /Root 1 0 R >>\nstartxref\n" << xref << "\n%%EOF\n";
+
+    std::ofstream file(path, std::ios::binary);
+    file << pdf.str();
+}
+
+// synthetic page / image in the requested style
+cv::Mat make_image(cv::Size size, const std::string &content, int index) {
+    cv::Mat img(size, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::RNG rng(index + 1);
+    if (content == "noise") {
+        rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+    } else if (content == "shapes") {
+        for (int i = 0; i < 40; i++) {
+            cv::Point a(rng.uniform(0, size.width), rng.uniform(0, size.height));
+            cv::Point b(rng.uniform(0, size.width), rng.uniform(0, size.height));
+            cv::rectangle(img, a, b, cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256)), cv::FILLED);
+        }
+    } else {
+        int line_h = std::max(12, size.height / 60);
+        for (int y = line_h; y < size.height; y += line_h) {
+            cv::putText(img, "The quick brown fox jumps over the lazy dog " + std::to_string(index), cv::Point(line_h, y),
+                        cv::FONT_HERSHEY_SIMPLEX, line_h / 30.0, cv::Scalar(0, 0, 0), 1, cv::LINE_AA);
+        }
+    }
+    return img;
+}
+
+void write_image_sequence(const std::string &dir, const BenchOptions &opts) {
+    fs::create_directories(dir);
+    for (int i = 0; i < opts.pages; i++) {
+        cv::imwrite(dir + std::to_string(i) + opts.image_ext, make_image(opts.image_size, opts.content, i));
+    }
+}
+
+// ====== //
+// Stages //
+// ====== //
+
+// high-water mark of the whole process, not of a stage
+long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// times `run`, which fills in count and bytes
+StageResult measure(const std::string &name, const std::string &unit, std::function<void(StageResult &)> run) {
+    std::cerr << "Benchmarking " << name << "..." << std::endl;
+    StageResult result;
+    result.name = name;
+    result.unit = unit;
+    auto start = std::chrono::steady_clock::now();
+    run(result);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// drains the loaders' queue, counting pages
+void drain(ptv::BoundedQueue<ptv::Page> &pages, StageResult &result) {
+    ptv::Page page;
+    while (pages.pop(page)) {
+        result.count++;
+        result.bytes += page.img.total() * page.img.elemSize();
+    }
+}
+
+StageResult bench_rasterize(ptv::Config &conf) {
+    return measure("rasterize", "pages", [&](StageResult &result) {
+        ptv::ThreadPool pool(conf.get_threads());
+        ptv::BoundedQueue<ptv::Page> pages(std::max<size_t>(DEFAULT_QUEUE_DEPTH, 2 * pool.size()));
+        std::thread loader([&] {
+            load_pdf_images(conf, pool, nullptr, pages);
+            pages.close();
+        });
+        drain(pages, result);
+        loader.join();
+    });
+}
+
+// listing the sequence directory and reading every header
+StageResult bench_index(ptv::Config &conf, ptv::SeqIndex &seq) {
+    return measure("index_sequence", "frames", [&](StageResult &result) {
+        ptv::ThreadPool pool(conf.get_threads());
+        seq = ptv::SeqIndex::build(conf.get_seq_dirs(), pool);
+        result.count = seq.size();
+    });
+}
+
+StageResult bench_decode(const ptv::SeqIndex &seq, ptv::Config &conf) {
+    return measure("decode_sequence", "frames", [&](StageResult &result) {
+        ptv::ThreadPool pool(conf.get_threads());
+        ptv::BoundedQueue<ptv::Page> pages(std::max<size_t>(DEFAULT_QUEUE_DEPTH, 2 * pool.size()));
+        std::thread loader([&] {
+            load_seq_images(seq, conf, pool, pages);
+            pages.close();
+        });
+        drain(pages, result);
+        loader.join();
+    });
+}
+
+// scale_image_to_fit() on full size images, only the resize is timed
+StageResult bench_scale(const BenchOptions &opts, ptv::Config &conf) {
+    cv::Mat src = make_image(opts.image_size, opts.content, 0);
+    StageResult result;
+    std::chrono::duration<double> spent(0);
+    for (int i = 0; i < opts.pages; i++) {
+        cv::Mat img = src.clone();
+        auto start = std::chrono::steady_clock::now();
+        scale_image_to_fit(img, conf);
+        spent += std::chrono::steady_clock::now() - start;
+        result.count++;
+        result.bytes += src.total() * src.elemSize();
+    }
+    result.name = "scale_image_to_fit";
+    result.unit = "frames";
+    result.seconds = spent.count();
+    return result;
+}
+
+// scroll compositor fed pages already at the output width, frames are not encoded
+StageResult bench_scroll(const BenchOptions &opts, bool smooth) {
+    int width = opts.resolution.width;
+    int height = opts.resolution.height;
+    int page_len = (int)std::lround((double)opts.page_size.height * width / opts.page_size.width);
+    page_len += page_len % 2;
+    std::vector<cv::Mat> sources = {
+        make_image(cv::Size(width, page_len), opts.content, 0),
+        make_image(cv::Size(width, page_len), opts.content, 1),
+    };
+    // about one viewport per second at 30 fps, fractional so smooth blends
+    float px_per_frame = height / 30.0f + 0.37f;
+    return measure(smooth ? "scroll_compositor_smooth" : "scroll_compositor", "frames", [&](StageResult &result) {
+        ptv::ScrollCompositor<ptv::Axis::Vertical, false> strip(width, height, page_len, px_per_frame, smooth);
+        cv::Mat frame;
+        for (int i = 0; i < opts.pages; i++) {
+            strip.append(sources[i % 2]);
+            while (strip.next_frame(frame)) {
+                result.count++;
+                result.bytes += frame.total() * frame.elemSize();
+            }
+        }
+    });
+}
+
+// letterboxing pages into frames, generate_sequence_video() into a NullEncoder
+StageResult bench_sequence(const BenchOptions &opts, ptv::Config &conf) {
+    cv::Mat src = make_image(opts.image_size, opts.content, 0);
+    scale_image_to_fit(src, conf);
+    return measure("sequence_compose", "frames", [&](StageResult &result) {
+        NullEncoder null;
+        ptv::BoundedQueue<ptv::Page> pages(DEFAULT_QUEUE_DEPTH);
+        std::thread loader([&] {
+            for (int i = 0; i < opts.pages; i++) {
+                if (!pages.push(ptv::Page{(size_t)i, src})) {
+                    break;
+                }
+            }
+            pages.close();
+        });
+        generate_sequence_video(null, pages, conf);
+        loader.join();
+        result.count = null.frames;
+        result.bytes = null.bytes;
+    });
+}
+
+StageResult bench_encode(const BenchOptions &opts, ptv::Config &conf) {
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 2; i++) {
+        cv::Mat frame = make_image(opts.image_size, opts.content, i);
+        cv::resize(frame, frame, opts.resolution);
+        frames.push_back(frame);
+    }
+    return measure("encode", "frames", [&](StageResult &result) {
+        std::unique_ptr<ptv::Encoder> video = ptv::open_encoder(conf);
+        if (!video->is_opened()) {
+            std::cerr << "<!> Error: Could not open the encoder." << std::endl;
+            return;
+        }
+        // every frame differs from the last, like a scroll
+        for (int i = 0; i < opts.pages * 10; i++) {
+            video->write(frames[i % 2]);
+            result.count++;
+            result.bytes += frames[0].total() * frames[0].elemSize();
+        }
+        video->release();
+    });
+}
+
+// A whole --stream render of the pdf into a named pipe. The reader walks
+// the top level mp4 boxes as they arrive and notes when the first moof
+// (the first page) shows up, the time a consumer waits for video.
+StageResult bench_stream(ptv::Config &conf) {
+    std::string fifo = conf.get_output();
+    fs::remove(fifo);
+    if (mkfifo(fifo.c_str(), 0600) != 0) {
+        std::cerr << "<!> Error: Could not create pipe '" << fifo << "'." << std::endl;
+        return StageResult{"stream", "fragments"};
+    }
+    StageResult stage = measure("stream", "fragments", [&](StageResult &result) {
+        auto start = std::chrono::steady_clock::now();
+        std::thread reader([&] {
+            std::ifstream in(fifo, std::ios::binary);
+            uint8_t head[8];
+            while (in.read((char *)head, 8)) {
+                uint64_t size = ((uint64_t)head[0] << 24) | (head[1] << 16) | (head[2] << 8) | head[3];
+                std::string type((char *)head + 4, 4);
+                size_t header = 8;
+                if (size == 1) {
+                    uint8_t large[8];
+                    if (!in.read((char *)large, 8)) {
+                        break;
+                    }
+                    size = 0;
+                    for (uint8_t b : large) {
+                        size = (size << 8) | b;
+                    }
+                    header = 16;
+                }
+                if (type == "moof") {
+                    if (result.count++ == 0) {
+                        result.first_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    }
+                }
+                result.bytes += size;
+                if (size < header || !in.ignore(size - header)) {
+                    break;
+                }
+            }
+        });
+        ptv::ThreadPool pool(conf.get_threads());
+        JobResult job = run_job(conf, pool, nullptr);
+        if (!job.ok) {
+            std::cerr << job.error << std::endl;
+        }
+        // unblocks the reader if the pipe was never opened for writing
+        int fd = open(fifo.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd >= 0) {
+            close(fd);
+        }
+        reader.join();
+    });
+    fs::remove(fifo);
+    return stage;
+}
+
+// ==== //
+// JSON //
+// ==== //
+
+void write_json(std::ostream &out, const BenchOptions &opts, const std::vector<StageResult> &results) {
+    out << "{\n";
+    out << "  \"pages\": " << opts.pages << ",\n";
+    out << "  \"resolution\": \"" << opts.resolution.width << "x" << opts.resolution.height << "\",\n";
+    out << "  \"page_size\": \"" << opts.page_size.width << "x" << opts.page_size.height << "\",\n";
+    out << "  \"image_size\": \"" << opts.image_size.width << "x" << opts.image_size.height << "\",\n";
+    out << "  \"content\": \"" << opts.content << "\",\n";
+    out << "  \"threads\": " << opts.threads << ",\n";
+    out << "  \"codec\": \"" << opts.codec << "\",\n";
+    out << "  \"allocator\": {\"hits\": " << ptv::PoolAllocator::get().hits() << ", \"misses\": " << ptv::PoolAllocator::get().misses()
+        << ", \"idle_mb\": " << ptv::PoolAllocator::get().idle_bytes() / (double)(1 << 20) << "},\n";
+    out << "  \"peak_rss_mb\": " << peak_rss_kb() / 1024.0 << ",\n";
+    out << "  \"stages\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const StageResult &r = results[i];
+        double per_s = r.seconds > 0 ? r.count / r.seconds : 0;
+        double mb_per_s = r.seconds > 0 ? r.bytes / r.seconds / (1 << 20) : 0;
+        out << "    {\"name\": \"" << r.name << "\", \"" << r.unit << "\": " << r.count
+            << ", \"seconds\": " << r.seconds
+            << ", \"" << r.unit << "_per_s\": " << per_s
+            << ", \"mb_per_s\": " << mb_per_s;
+        if (r.first_seconds >= 0) {
+            out << ", \"first_fragment_s\": " << r.first_seconds;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}" << std::endl;
+}
+
+// generates the corpus in opts.work_dir and runs every stage on it,
+// throws ptv::ConfigError if the options are rejected (e.g. an unknown codec)
+std::vector<StageResult> run_stages(const BenchOptions &opts) {
+    std::string pdf_path = opts.work_dir + "/corpus.pdf";
+    std::string seq_dir = opts.work_dir + "/corpus_seq/";
+    std::string video_path = opts.work_dir + "/bench.mp4";
+    std::string stream_path = opts.work_dir + "/stream.mp4";
+
+    std::cerr << "Generating corpus in " << opts.work_dir << "..." << std::endl;
+    write_pdf(pdf_path, opts);
+    write_image_sequence(seq_dir, opts);
+
+    std::string res = std::to_string(opts.resolution.width) + "x" + std::to_string(opts.resolution.height);
+    std::string threads = std::to_string(opts.threads);
+    ptv::Config pdf_conf({pdf_path, "-r", res, "-j", threads, "-o", video_path, "-c", opts.codec});
+    ptv::Config seq_conf({seq_dir, "-r", res, "-j", threads, "-o", video_path, "-c", opts.codec});
+    // stages run outside run_job(), frames of the bench resolution are pooled for all of them
+    ptv::PooledSizes pooled(get_pooled_sizes({}, pdf_conf));
+
+    std::vector<StageResult> results;
+    results.push_back(bench_rasterize(pdf_conf));
+    ptv::SeqIndex seq;
+    results.push_back(bench_index(seq_conf, seq));
+    results.push_back(bench_decode(seq, seq_conf));
+    results.push_back(bench_scale(opts, seq_conf));
+    results.push_back(bench_scroll(opts, false));
+    results.push_back(bench_scroll(opts, true));
+    results.push_back(bench_sequence(opts, seq_conf));
+    results.push_back(bench_encode(opts, pdf_conf));
+    if (ptv::stream_supported()) {
+        ptv::Config stream_conf({pdf_path, "-r", res, "-j", threads, "-o", stream_path, "-c", opts.codec, "--stream"});
+        results.push_back(bench_stream(stream_conf));
+    }
+    return results;
+}
+
+// ============= //
+// Main Function //
+// ============= //
+
+int main(int argc, char **argv) {
+    ptv::PoolAllocator::install();
+    BenchOptions opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = std::string(argv[i]);
+        if (arg == "-h" || arg == "--help") {
+            std::cout << BENCH_HELP_TXT << std::endl;
+            return 0;
+        } else if (i + 1 >= argc) {
+            std::cerr << "<!> Missing value for '" << arg << "'." << std::endl;
+            return 1;
+        } else if (arg == "-n") {
+            opts.pages = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "-r") {
+            opts.resolution = parse_size(argv[++i]);
+        } else if (arg == "-p") {
+            opts.page_size = parse_size(argv[++i]);
+        } else if (arg == "-i") {
+            opts.image_size = parse_size(argv[++i]);
+        } else if (arg == "-c") {
+            opts.content = argv[++i];
+            if (opts.content != "text" && opts.content != "shapes" && opts.content != "noise") {
+                std::cerr << "<!> Invalid input for '-c'. Must be [text|shapes|noise]" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-e") {
+            opts.image_ext = std::string(".") + argv[++i];
+        } else if (arg == "-j") {
+            opts.threads = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "-k") {
+            opts.codec = argv[++i];
+        } else if (arg == "-w") {
+            opts.work_dir = argv[++i];
+        } else if (arg == "-o") {
+            opts.output = argv[++i];
+        } else {
+            std::cerr << "<!> Unknown argument detected: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    bool temp_dir = opts.work_dir == "";
+    if (temp_dir) {
+        opts.work_dir = (fs::temp_directory_path() / ("ptv-bench-" + std::to_string(getpid()))).string();
+    }
+    fs::create_directories(opts.work_dir);
+    int status = 0;
+    try {
+        std::vector<StageResult> results = run_stages(opts);
+        if (opts.output == "") {
+            write_json(std::cout, opts, results);
+        } else {
+            std::ofstream file(opts.output);
+            write_json(file, opts, results);
+        }
+    } catch (const ptv::ConfigError &e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+
+    if (temp_dir) {
+        std::error_code err;
+        fs::remove_all(opts.work_dir, err);
+    }
+    return status;
+}
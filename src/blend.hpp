@@ -0,0 +1,93 @@
+#ifndef PTV_BLEND_HPP
+#define PTV_BLEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PTV_BLEND_X86
+#include <immintrin.h>
+#endif
+
+namespace ptv {
+
+// Blends two byte spans: dst = (a * (256 - w) + b * w) / 256, w in [0, 256].
+// Used for sub-pixel scrolling, where `b` is `a` moved by one pixel.
+//
+// The SSE2/AVX2 kernels process 16/32 bytes per iteration in 16 bit fixed
+// point. The widest one the cpu supports is picked once at runtime, so the
+// binary does not need to be built with -mavx2.
+
+inline void blend_span_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n, int w) {
+    int wa = 256 - w;
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (uint8_t)((a[i] * wa + b[i] * w + 128) >> 8);
+    }
+}
+
+#ifdef PTV_BLEND_X86
+__attribute__((target("sse2")))
+inline void blend_span_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n, int w) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vwa = _mm_set1_epi16((short)(256 - w));
+    const __m128i vwb = _mm_set1_epi16((short)w);
+    const __m128i half = _mm_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), vwa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), vwb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), vwa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), vwb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    blend_span_scalar(a + i, b + i, dst + i, n - i, w);
+}
+
+__attribute__((target("avx2")))
+inline void blend_span_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n, int w) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vwa = _mm256_set1_epi16((short)(256 - w));
+    const __m256i vwb = _mm256_set1_epi16((short)w);
+    const __m256i half = _mm256_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        // unpack/pack work per 128 bit lane, so the lanes line back up after packus
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), vwa),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), vwb));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), vwa),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), vwb));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, half), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, half), 8);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    blend_span_sse2(a + i, b + i, dst + i, n - i, w);
+}
+#endif
+
+typedef void (*BlendSpanFn)(const uint8_t *, const uint8_t *, uint8_t *, size_t, int);
+
+inline BlendSpanFn select_blend_span() {
+#ifdef PTV_BLEND_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return blend_span_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return blend_span_sse2;
+    }
+#endif
+    return blend_span_scalar;
+}
+
+inline void blend_span(const uint8_t *a, const uint8_t *b, uint8_t *dst, size_t n, int w) {
+    static const BlendSpanFn fn = select_blend_span();
+    fn(a, b, dst, n, w);
+}
+
+}
+#endif
@@ -0,0 +1,158 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace ptv {
+
+// 'ptv1' followed by rows, cols and cv type
+struct EntryHeader {
+    uint32_t magic = 0x31767470;
+    int32_t rows = 0;
+    int32_t cols = 0;
+    int32_t type = 0;
+};
+
+PageCache::PageCache(const std::string &dir, uintmax_t max_bytes) : dir_(dir), max_bytes_(max_bytes) {
+    std::error_code err;
+    fs::create_directories(dir_, err);
+    if (err) {
+        std::cerr << "<!> Warning: Could not create cache directory '" << dir << "': " << err.message() << std::endl;
+        return;
+    }
+    for (const auto &entry : fs::directory_iterator(dir_, err)) {
+        if (entry.is_regular_file()) {
+            size_ += entry.file_size();
+        }
+    }
+    evict();
+}
+
+// 64 bit FNV-1a over the whole file
+uint64_t PageCache::hash_file(const std::string &path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buf(1 << 20);
+    while (file) {
+        file.read(buf.data(), buf.size());
+        std::streamsize n = file.gcount();
+        for (std::streamsize i = 0; i < n; i++) {
+            hash ^= (uint8_t)buf[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+std::string PageCache::key(uint64_t doc_hash, int page, float dpi, int type) {
+    // dpi to 1/1000, small float noise should not miss the cache
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "%016llx-%d-%ld-%d.raw", (unsigned long long)doc_hash, page, std::lround(dpi * 1000.0f), type);
+    return std::string(buf);
+}
+
+bool PageCache::load(const std::string &key, cv::Mat &img, int type) {
+    fs::path path = dir_ / key;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    EntryHeader header;
+    EntryHeader expected;
+    file.read((char *)&header, sizeof(header));
+    if (!file || header.magic != expected.magic || header.rows <= 0 || header.cols <= 0 || header.type != type) {
+        return false;
+    }
+    std::error_code err;
+    uintmax_t bytes = (uintmax_t)header.rows * header.cols * CV_ELEM_SIZE(type);
+    if (fs::file_size(path, err) != sizeof(header) + bytes || err) {
+        return false;
+    }
+    img.create(header.rows, header.cols, type);
+    file.read((char *)img.data, img.total() * img.elemSize());
+    if (!file) {
+        img.release();
+        return false;
+    }
+
+    // marks it as recently used
+    fs::last_write_time(path, fs::file_time_type::clock::now(), err);
+    return true;
+}
+
+// `img` may be a view (ex. the page inside a letterboxed frame), rows are written one by one
+void PageCache::store(const std::string &key, const cv::Mat &img) {
+    EntryHeader header;
+    header.rows = img.rows;
+    header.cols = img.cols;
+    header.type = img.type();
+    size_t row_bytes = img.cols * img.elemSize();
+
+    std::ostringstream tmp_name;
+    tmp_name << key << "." << std::this_thread::get_id() << ".tmp";
+    fs::path tmp = dir_ / tmp_name.str();
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        file.write((const char *)&header, sizeof(header));
+        for (int r = 0; r < img.rows; r++) {
+            file.write((const char *)img.ptr(r), row_bytes);
+        }
+        if (!file) {
+            std::error_code err;
+            fs::remove(tmp, err);
+            return;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp, dir_ / key, err);
+    if (err) {
+        fs::remove(tmp, err);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ += sizeof(header) + row_bytes * img.rows;
+    if (size_ > max_bytes_) {
+        evict();
+    }
+}
+
+// removes least recently used entries until the cache is back under 90% of its cap
+void PageCache::evict() {
+    if (size_ <= max_bytes_) {
+        return;
+    }
+    struct Entry {
+        fs::path path;
+        fs::file_time_type time;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    std::error_code err;
+    size_ = 0;
+    for (const auto &entry : fs::directory_iterator(dir_, err)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".raw") {
+            entries.push_back({entry.path(), entry.last_write_time(), entry.file_size()});
+            size_ += entries.back().size;
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+    uintmax_t target = max_bytes_ / 10 * 9;
+    for (const Entry &entry : entries) {
+        if (size_ <= target) {
+            break;
+        }
+        if (fs::remove(entry.path, err)) {
+            size_ -= entry.size;
+        }
+    }
+}
+
+}
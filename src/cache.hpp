@@ -0,0 +1,47 @@
+#ifndef PTV_CACHE_HPP
+#define PTV_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include "opencv.hpp"
+
+namespace ptv {
+
+// On-disk cache of rasterized pdf pages, shared between runs.
+//
+// Entries are keyed by the pdf's content hash, the page index, the dpi it
+// was rendered at and the page's pixel type (gray pages are CV_8UC1, see
+// gray.hpp), so changing only timing settings
+// (-f, -s, -d) reuses every page. Each entry is one raw file: a small
+// header followed by the pixel rows, read straight into the page's buffer.
+//
+// The cache is capped at `max_bytes`. Hits refresh the file's modified
+// time and the oldest files are evicted first (LRU). Files are written
+// under a temporary name and renamed, so concurrent runs never read a
+// partial entry. Safe to use from several render threads.
+class PageCache {
+    std::filesystem::path dir_;
+    uintmax_t max_bytes_;
+    uintmax_t size_ = 0; // bytes on disk, approximate between evictions
+    std::mutex mutex_;
+
+    void evict();
+
+    public:
+        PageCache(const std::string &dir, uintmax_t max_bytes);
+
+        // content hash of a file, used as the document part of the key
+        static uint64_t hash_file(const std::string &path);
+
+        static std::string key(uint64_t doc_hash, int page, float dpi, int type);
+
+        // fills `img` and returns true on a hit. entries of another type
+        // than `type`, or whose size disagrees with the file, are misses.
+        bool load(const std::string &key, cv::Mat &img, int type);
+        void store(const std::string &key, const cv::Mat &img);
+};
+
+}
+#endif
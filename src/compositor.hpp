@@ -0,0 +1,253 @@
+#ifndef PTV_COMPOSITOR_HPP
+#define PTV_COMPOSITOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "blend.hpp"
+#include "opencv.hpp"
+#include "stats.hpp"
+
+namespace ptv {
+
+enum class Axis { Vertical, Horizontal };
+
+// Builds the scroll animation in one preallocated strip.
+//
+// The strip only holds what is still visible plus the page being scrolled
+// in. Pages are copied in once, and frames are handed out as views into the
+// strip, so writing a frame does no allocation or copy. When a page no
+// longer fits after the filled part, the part still in use is moved back to
+// the start of the strip (at most one viewport per page).
+//
+// A is the axis content moves along. Reverse scrolls against reading order:
+// the strip fills from its far end and the viewport walks back towards the
+// start, so Down/Right are the same code as Up/Left.
+//   Up:    <Axis::Vertical, false>     Down:  <Axis::Vertical, true>
+//   Left:  <Axis::Horizontal, false>   Right: <Axis::Horizontal, true>
+//
+// The strip is gray (CV_8UC1) or BGR. A gray strip turns BGR for good at
+// the first color page, gray pages are expanded as they are copied into a
+// BGR strip, so monochrome documents are composed at a third of the bytes.
+//
+// With `smooth` the viewport is not snapped to whole pixels. Frames at a
+// fractional position are blended from the two nearest pixel offsets into
+// one reused frame buffer (see blend.hpp); whole-pixel frames stay views.
+//
+// Positions below are "logical": distance from where filling started.
+// Frame n sits at n * px_per_frame, computed rather than summed, so a
+// compositor that seek()s to a frame produces exactly the frames a
+// compositor that got there from the start would. That is what lets
+// --segments compose parts of the video independently.
+template <Axis A, bool Reverse>
+class ScrollCompositor {
+    int along_;         // viewport length along the scroll axis
+    int across_;        // viewport length across it
+    float step_;        // pixels scrolled per frame
+    int64_t n_ = 0;     // next frame
+    int64_t base_ = 0;  // logical position of the strip's start
+    double h_ = 0.0;    // start of the viewport, relative to base_
+    int end_ = 0;       // filled length, relative to base_
+    bool smooth_;
+    cv::Mat strip_;
+    cv::Mat frame_;     // blended frame, only used when smooth
+
+    static int length(const cv::Mat &m) { return A == Axis::Vertical ? m.rows : m.cols; }
+    static int breadth(const cv::Mat &m) { return A == Axis::Vertical ? m.cols : m.rows; }
+
+    // [begin, end) along the scroll axis
+    static cv::Mat span(const cv::Mat &m, int begin, int end) {
+        if constexpr (A == Axis::Vertical) {
+            return m.rowRange(begin, end);
+        } else {
+            return m.colRange(begin, end);
+        }
+    }
+
+    // [begin, end) across the scroll axis
+    static cv::Mat cross(const cv::Mat &m, int begin, int end) {
+        if constexpr (A == Axis::Vertical) {
+            return m.colRange(begin, end);
+        } else {
+            return m.rowRange(begin, end);
+        }
+    }
+
+    // where logical [begin, end) sits in the strip
+    static int physical(const cv::Mat &strip, int begin, int end) {
+        if constexpr (Reverse) {
+            return length(strip) - end;
+        } else {
+            (void)strip;
+            (void)end;
+            return begin;
+        }
+    }
+
+    cv::Mat view(int begin, int end) const {
+        int p = physical(strip_, begin, end);
+        return span(strip_, p, p + end - begin);
+    }
+
+    // blends the strip at physical offsets p and p + 1 into frame_
+    void blend(int p, int w) {
+        if constexpr (A == Axis::Vertical) {
+            // the two views are contiguous and one row apart
+            blend_span(strip_.ptr(p), strip_.ptr(p + 1), frame_.ptr(0), frame_.total() * frame_.elemSize(), w);
+        } else {
+            size_t px = strip_.elemSize();
+            for (int r = 0; r < strip_.rows; r++) {
+                const uint8_t *src = strip_.ptr(r) + p * px;
+                blend_span(src, src + px, frame_.ptr(r), (size_t)along_ * px, w);
+            }
+        }
+    }
+
+    // moves logical [top of vp, end_) to the start of the strip
+    void compact() {
+        int top = (int)h_;
+        if (top == 0) {
+            return;
+        }
+        int len = end_ - top;
+        int src = physical(strip_, top, end_);
+        int dst = physical(strip_, 0, len);
+        if constexpr (A == Axis::Vertical) {
+            // rows are contiguous, the whole block moves at once
+            std::memmove(strip_.ptr(dst), strip_.ptr(src), (size_t)len * strip_.step[0]);
+        } else {
+            size_t px = strip_.elemSize();
+            for (int r = 0; r < strip_.rows; r++) {
+                std::memmove(strip_.ptr(r) + dst * px, strip_.ptr(r) + src * px, (size_t)len * px);
+            }
+        }
+        h_ -= top;
+        end_ -= top;
+        base_ += top;
+    }
+
+    // the strip (and the blend buffer) from gray to BGR
+    void promote() {
+        cv::Mat bgr;
+        cv::cvtColor(strip_, bgr, cv::COLOR_GRAY2BGR);
+        strip_ = bgr;
+        if (smooth_) {
+            frame_ = cv::Mat(frame_.size(), CV_8UC3, cv::Scalar(0, 0, 0));
+        }
+    }
+
+    // makes sure `len` more fits after the filled part
+    void reserve(int len) {
+        if (end_ + len <= length(strip_)) {
+            return;
+        }
+        compact();
+        if (end_ + len <= length(strip_)) {
+            return;
+        }
+        // page is longer than the strip was sized for
+        cv::Mat bigger = A == Axis::Vertical
+            ? cv::Mat(end_ + len, across_, strip_.type(), cv::Scalar(0, 0, 0))
+            : cv::Mat(across_, end_ + len, strip_.type(), cv::Scalar(0, 0, 0));
+        int p = physical(bigger, 0, end_);
+        view(0, end_).copyTo(span(bigger, p, p + end_));
+        strip_ = bigger;
+    }
+
+    public:
+        // width/height are the video resolution. max_page_len sizes the strip,
+        // longer pages still work but reallocate it. `type` is the strip's
+        // starting type, CV_8UC1 if pages may be gray.
+        ScrollCompositor(int width, int height, int max_page_len, float px_per_frame, bool smooth = false, int type = CV_8UC3)
+            : along_(A == Axis::Vertical ? height : width),
+              across_(A == Axis::Vertical ? width : height),
+              step_(px_per_frame),
+              smooth_(smooth) {
+            int tail = along_ + (int)std::ceil(step_) + 1; // live part left after a page is scrolled
+            int len = 2 * tail + std::max(max_page_len, tail);
+            strip_ = A == Axis::Vertical
+                ? cv::Mat(len, across_, type, cv::Scalar(0, 0, 0))
+                : cv::Mat(across_, len, type, cv::Scalar(0, 0, 0));
+            end_ = along_; // starts on a black viewport
+            if (smooth_) {
+                frame_ = cv::Mat(height, width, type, cv::Scalar(0, 0, 0));
+            }
+        }
+
+        // length of the viewport along the scroll axis
+        int viewport() { return along_; }
+
+        // Empties the strip and continues at `frame`. The next append()
+        // lands at logical position `origin`, which must be at or before
+        // the frame's viewport. Position 0 is the start of the black
+        // viewport a new compositor starts on.
+        void seek(int64_t frame, int64_t origin) {
+            n_ = frame;
+            base_ = origin;
+            end_ = 0;
+            h_ = (double)n_ * step_ - base_;
+        }
+
+        // copies a page in after the filled part
+        void append(const cv::Mat &page) {
+            ScopedTimer timer("compose");
+            timer.add_bytes(page.total() * page.elemSize());
+            int len = length(page);
+            if (page.channels() == 3 && strip_.channels() == 1) {
+                promote();
+            }
+            reserve(len);
+            int n = std::min(breadth(page), across_);
+            cv::Mat dst = view(end_, end_ + len);
+            cv::Mat out = cross(dst, 0, n);
+            if (page.channels() == 1 && strip_.channels() == 3) {
+                cv::cvtColor(cross(page, 0, n), out, cv::COLOR_GRAY2BGR);
+            } else {
+                cross(page, 0, n).copyTo(out);
+            }
+            if (n < across_) {
+                cross(dst, n, across_).setTo(cv::Scalar(0, 0, 0));
+            }
+            end_ += len;
+        }
+
+        // adds black, used to scroll out to black at the end
+        void append_blank(int len) {
+            reserve(len);
+            view(end_, end_ + len).setTo(cv::Scalar(0, 0, 0));
+            end_ += len;
+        }
+
+        // sets `frame` to a view of the next frame and scrolls one step.
+        // returns false when the filled part runs out.
+        bool next_frame(cv::Mat &frame) {
+            if ((double)end_ - (h_ + along_) <= step_) {
+                return false;
+            }
+            int top = (int)h_;
+            int w = smooth_ ? (int)std::lround((h_ - top) * 256.0f) : 0;
+            if (w == 0) {
+                frame = view(top, top + along_);
+            } else if (w == 256) {
+                frame = view(top + 1, top + 1 + along_);
+            } else {
+                // physical offsets run backwards when Reverse, so the weight flips
+                ScopedTimer timer("blend");
+                timer.add_bytes(frame_.total() * frame_.elemSize());
+                int p = physical(strip_, top, top + along_);
+                if constexpr (Reverse) {
+                    blend(p - 1, 256 - w);
+                } else {
+                    blend(p, w);
+                }
+                frame = frame_;
+            }
+            n_++;
+            h_ = (double)n_ * step_ - base_;
+            return true;
+        }
+};
+
+}
+#endif
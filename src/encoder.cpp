@@ -0,0 +1,877 @@
+#include "encoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "stats.hpp"
+#include "yuv.hpp"
+
+#ifdef PTV_WITH_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+namespace ptv {
+
+// =========== //
+// cv::VideoWriter //
+// =========== //
+
+// fourcc OpenCV's ffmpeg backend maps to each codec
+int get_fourcc(const std::string &codec) {
+    if (codec == H264) {
+        return cv::VideoWriter::fourcc('a', 'v', 'c', '1');
+    } else if (codec == H265) {
+        return cv::VideoWriter::fourcc('h', 'e', 'v', '1');
+    } else if (codec == AV1) {
+        return cv::VideoWriter::fourcc('a', 'v', '0', '1');
+    }
+    return cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+}
+
+CvEncoder::CvEncoder(Config &conf) {
+    cv::Size frame_size(conf.get_width(), conf.get_height());
+    vid_ = cv::VideoWriter(conf.get_output(), cv::CAP_FFMPEG, get_fourcc(conf.get_codec()), conf.get_fps(), frame_size, true);
+    if (!vid_.isOpened() && conf.get_codec() != MPEG4) {
+        std::cerr << "<!> Warning: OpenCV could not encode " << conf.get_codec() << ", using mpeg4." << std::endl;
+        vid_ = cv::VideoWriter(conf.get_output(), cv::CAP_FFMPEG, get_fourcc(MPEG4), conf.get_fps(), frame_size, true);
+    }
+}
+
+void CvEncoder::write(const cv::Mat &frame) {
+    if (frame.channels() == 1) {
+        cv::cvtColor(frame, bgr_, cv::COLOR_GRAY2BGR);
+        write(bgr_);
+        return;
+    }
+    vid_.write(frame);
+    last_ = frame;
+}
+
+void CvEncoder::write_i420(const cv::Mat &yuv) {
+    cv::cvtColor(yuv, bgr_, cv::COLOR_YUV2BGR_I420);
+    write(bgr_);
+}
+
+// cv::VideoWriter is constant frame rate, the frame has to be repeated
+void CvEncoder::hold(int64_t frames) {
+    if (last_.empty()) {
+        return;
+    }
+    for (int64_t i = 0; i < frames; i++) {
+        vid_.write(last_);
+    }
+}
+
+#ifdef PTV_WITH_LIBAV
+
+// ===== //
+// libav //
+// ===== //
+
+// libav encoder name for each codec
+std::string get_encoder_name(const std::string &codec) {
+    if (codec == H264) {
+        return "libx264";
+    } else if (codec == H265) {
+        return "libx265";
+    } else if (codec == AV1) {
+        return "libsvtav1";
+    }
+    return "mpeg4";
+}
+
+std::string av_error_string(int err) {
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(err, buf, sizeof(buf));
+    return std::string(buf);
+}
+
+// Opens the encoder for `conf` with output in `format`, null on failure.
+// Every frame sent as an I frame becomes an IDR frame (page starts). With
+// `intra_pages` frames are never reordered, for the incremental encoder.
+AVCodecContext *open_codec(Config &conf, const AVOutputFormat *format, bool intra_pages) {
+    std::string name = get_encoder_name(conf.get_codec());
+    const AVCodec *codec = avcodec_find_encoder_by_name(name.c_str());
+    if (codec == nullptr) {
+        std::cerr << "<!> Warning: libav encoder '" << name << "' not found." << std::endl;
+        return nullptr;
+    }
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (ctx == nullptr) {
+        std::cerr << "<!> Error: Out of memory opening the encoder." << std::endl;
+        return nullptr;
+    }
+
+    // one tick per frame, pts are frame numbers
+    AVRational fps = av_d2q(conf.get_fps(), 100000);
+    ctx->width = conf.get_width();
+    ctx->height = conf.get_height();
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->framerate = fps;
+    ctx->time_base = av_inv_q(fps);
+    ctx->thread_count = conf.get_encoder_threads();
+    // libavcodec's default is a keyframe every 12 frames, page starts
+    // are keyframes anyway
+    ctx->gop_size = conf.get_gop() > 0 ? conf.get_gop() : std::max(1, (int)std::lround(conf.get_fps() * DEFAULT_GOP_SECONDS));
+    if (format->flags & AVFMT_GLOBALHEADER) {
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    AVDictionary *opts = nullptr;
+    if (conf.get_codec() == H264 || conf.get_codec() == H265) {
+        av_dict_set(&opts, "forced-idr", "1", 0);
+    }
+    if (intra_pages) {
+        ctx->max_b_frames = 0;
+    }
+    if (conf.get_preset() != "") {
+        av_dict_set(&opts, "preset", conf.get_preset().c_str(), 0);
+    }
+    if (conf.get_stream() && (conf.get_codec() == H264 || conf.get_codec() == H265)) {
+        // no lookahead or frame reordering, packets come out as frames go in
+        av_dict_set(&opts, "tune", "zerolatency", 0);
+    }
+    if (conf.get_crf() >= 0) {
+        if (conf.get_codec() == MPEG4) {
+            ctx->flags |= AV_CODEC_FLAG_QSCALE;
+            ctx->global_quality = FF_QP2LAMBDA * conf.get_crf();
+        } else {
+            av_dict_set_int(&opts, "crf", conf.get_crf(), 0);
+        }
+    }
+    int err = avcodec_open2(ctx, codec, &opts);
+    av_dict_free(&opts);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not open encoder '" << name << "': " << av_error_string(err) << std::endl;
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+// Appends a chapter from `start` on, its end is set by end_chapters(). The
+// first one is added before the header so mp4 makes room for a chapter
+// track, without a title until the first page fills it in. A chapter at
+// the same start as the last one only renames it.
+void add_chapter(AVFormatContext *fmt, AVRational time_base, int64_t start, const std::string &title) {
+    AVChapter *ch = nullptr;
+    AVChapter *last = fmt->nb_chapters > 0 ? fmt->chapters[fmt->nb_chapters - 1] : nullptr;
+    if (last != nullptr && (last->start == start || (fmt->nb_chapters == 1 && av_dict_get(last->metadata, "title", nullptr, 0) == nullptr))) {
+        ch = last;
+    } else {
+        AVChapter **chapters = (AVChapter **)av_realloc_array(fmt->chapters, fmt->nb_chapters + 1, sizeof(AVChapter *));
+        if (chapters == nullptr) {
+            return;
+        }
+        fmt->chapters = chapters;
+        ch = (AVChapter *)av_mallocz(sizeof(AVChapter));
+        if (ch == nullptr) {
+            return;
+        }
+        ch->id = fmt->nb_chapters;
+        fmt->chapters[fmt->nb_chapters++] = ch;
+    }
+    ch->time_base = time_base;
+    ch->start = start;
+    ch->end = start;
+    if (title != "") {
+        av_dict_set(&ch->metadata, "title", title.c_str(), 0);
+    }
+}
+
+// each chapter ends where the next one starts, the last one at `end`
+void end_chapters(AVFormatContext *fmt, int64_t end) {
+    for (unsigned int i = 0; i < fmt->nb_chapters; i++) {
+        AVChapter *ch = fmt->chapters[i];
+        ch->end = i + 1 < fmt->nb_chapters ? av_rescale_q(fmt->chapters[i + 1]->start, fmt->chapters[i + 1]->time_base, ch->time_base)
+                                           : end;
+        ch->end = std::max(ch->end, ch->start);
+    }
+}
+
+AvEncoder::AvEncoder(Config &conf, const std::string &path) : streaming_(conf.get_stream()) {
+    std::string output = path != "" ? path : conf.get_output();
+    const char *format = nullptr;
+    if (output == "-") {
+        format = "mp4";
+        output = "pipe:1";
+    }
+    int err = avformat_alloc_output_context2(&fmt_, nullptr, format, output.c_str());
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not create output '" << output << "': " << av_error_string(err) << std::endl;
+        return;
+    }
+    ctx_ = open_codec(conf, fmt_->oformat, false);
+    if (ctx_ == nullptr) {
+        close();
+        return;
+    }
+    stream_ = avformat_new_stream(fmt_, nullptr);
+    frame_ = av_frame_alloc();
+    pkt_ = av_packet_alloc();
+    if (stream_ == nullptr || frame_ == nullptr || pkt_ == nullptr) {
+        std::cerr << "<!> Error: Out of memory opening the encoder." << std::endl;
+        close();
+        return;
+    }
+
+    avcodec_parameters_from_context(stream_->codecpar, ctx_);
+    stream_->time_base = ctx_->time_base;
+    stream_->avg_frame_rate = ctx_->framerate;
+
+    if (!(fmt_->oformat->flags & AVFMT_NOFILE)) {
+        err = avio_open(&fmt_->pb, output.c_str(), AVIO_FLAG_WRITE);
+        if (err < 0) {
+            std::cerr << "<!> Error: Could not open '" << output << "': " << av_error_string(err) << std::endl;
+            close();
+            return;
+        }
+    }
+    AVDictionary *opts = nullptr;
+    if (streaming_) {
+        // fragments are cut by flush()
+        av_dict_set(&opts, "movflags", "empty_moov+default_base_moof+frag_custom", 0);
+    } else {
+        add_chapter(fmt_, ctx_->time_base, 0, "");
+    }
+    err = avformat_write_header(fmt_, &opts);
+    av_dict_free(&opts);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not write header: " << av_error_string(err) << std::endl;
+        close();
+        return;
+    }
+    if (streaming_) {
+        avio_flush(fmt_->pb);
+    }
+
+    frame_->format = ctx_->pix_fmt;
+    frame_->width = ctx_->width;
+    frame_->height = ctx_->height;
+    if (av_frame_get_buffer(frame_, 0) < 0) {
+        close();
+        return;
+    }
+    opened_ = true;
+}
+
+AvEncoder::~AvEncoder() {
+    release();
+}
+
+// encodes one frame lasting `duration` frames (nullptr flushes)
+// and muxes every packet that comes out
+void AvEncoder::send(AVFrame *frame, int64_t duration) {
+    if (frame != nullptr) {
+        frame->pts = next_pts_;
+        frame->duration = duration;
+        next_pts_ += duration;
+    }
+    int err = avcodec_send_frame(ctx_, frame);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not encode frame: " << av_error_string(err) << std::endl;
+        return;
+    }
+    while (avcodec_receive_packet(ctx_, pkt_) == 0) {
+        av_packet_rescale_ts(pkt_, ctx_->time_base, stream_->time_base);
+        pkt_->stream_index = stream_->index;
+        av_interleaved_write_frame(fmt_, pkt_);
+    }
+}
+
+void AvEncoder::flush_pending() {
+    if (pending_ > 0) {
+        send(frame_, pending_);
+        pending_ = 0;
+    }
+}
+
+// the waiting frame is encoded with the length held so far, and the
+// packets muxed since the last flush go out as one fragment
+void AvEncoder::flush() {
+    if (!opened_ || !streaming_) {
+        return;
+    }
+    flush_pending();
+    av_write_frame(fmt_, nullptr);
+    avio_flush(fmt_->pb);
+}
+
+void AvEncoder::mark_page(const std::string &title) {
+    mark_ = true;
+    title_ = title;
+}
+
+// sends the waiting frame and makes frame_ ready for the next one,
+// a keyframe if it starts a page
+bool AvEncoder::next_frame() {
+    if (!opened_) {
+        return false;
+    }
+    flush_pending();
+    frame_->pict_type = mark_ ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    if (mark_ && !streaming_) {
+        add_chapter(fmt_, ctx_->time_base, next_pts_, title_);
+    }
+    mark_ = false;
+    return av_frame_make_writable(frame_) >= 0;
+}
+
+// Gray frames skip swscale: luma through a table (the BGR formula, so gray
+// and color pages match) and flat chroma.
+void write_gray_frame(const cv::Mat &gray, AVFrame *frame) {
+    static const cv::Mat lut = [] {
+        cv::Mat t(1, 256, CV_8UC1);
+        for (int i = 0; i < 256; i++) {
+            t.at<uint8_t>(i) = gray_to_y(i);
+        }
+        return t;
+    }();
+    cv::Mat y(frame->height, frame->width, CV_8UC1, frame->data[0], frame->linesize[0]);
+    cv::LUT(gray, lut, y);
+    for (int p = 1; p < 3; p++) {
+        for (int r = 0; r < frame->height / 2; r++) {
+            std::memset(frame->data[p] + (size_t)r * frame->linesize[p], YUV_BLACK_UV, frame->width / 2);
+        }
+    }
+}
+
+void AvEncoder::write(const cv::Mat &frame) {
+    if (!next_frame()) {
+        return;
+    }
+    if (frame.channels() == 1) {
+        write_gray_frame(frame, frame_);
+        pending_ = 1;
+        return;
+    }
+    sws_ = sws_getCachedContext(sws_, frame.cols, frame.rows, AV_PIX_FMT_BGR24,
+                                ctx_->width, ctx_->height, AV_PIX_FMT_YUV420P,
+                                SWS_BILINEAR, nullptr, nullptr, nullptr);
+    const uint8_t *src[1] = {frame.data};
+    const int stride[1] = {(int)frame.step[0]};
+    sws_scale(sws_, src, stride, 0, frame.rows, frame_->data, frame_->linesize);
+    pending_ = 1;
+}
+
+void AvEncoder::write_i420(const cv::Mat &yuv) {
+    if (!next_frame()) {
+        return;
+    }
+    int w = ctx_->width;
+    int h = ctx_->height;
+    const uint8_t *y = yuv.data;
+    const uint8_t *u = y + (size_t)w * h;
+    const uint8_t *v = u + (size_t)(w / 2) * (h / 2);
+    av_image_copy_plane(frame_->data[0], frame_->linesize[0], y, w, w, h);
+    av_image_copy_plane(frame_->data[1], frame_->linesize[1], u, w / 2, w / 2, h / 2);
+    av_image_copy_plane(frame_->data[2], frame_->linesize[2], v, w / 2, w / 2, h / 2);
+    pending_ = 1;
+}
+
+void AvEncoder::release() {
+    if (opened_) {
+        // The muxer takes a frame's length from the next timestamp. The last
+        // frame has none, so a held last frame is sent once more at its end.
+        if (pending_ > 1) {
+            int64_t last = pending_;
+            send(frame_, last - 1);
+            frame_->pict_type = AV_PICTURE_TYPE_NONE;
+            send(frame_, 1);
+            pending_ = 0;
+        }
+        flush_pending();
+        send(nullptr, 0);
+        end_chapters(fmt_, next_pts_);
+        av_write_trailer(fmt_);
+        opened_ = false;
+    }
+    close();
+}
+
+void AvEncoder::close() {
+    if (fmt_ != nullptr && fmt_->pb != nullptr && !(fmt_->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&fmt_->pb);
+    }
+    sws_freeContext(sws_);
+    sws_ = nullptr;
+    av_packet_free(&pkt_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&ctx_);
+    avformat_free_context(fmt_);
+    fmt_ = nullptr;
+    stream_ = nullptr;
+}
+
+// =========== //
+// incremental //
+// =========== //
+
+IncrementalEncoder::IncrementalEncoder(Config &conf) : verbose_(conf.get_verbose()), output_(conf.get_output()) {
+    // the container is picked from the output name, nothing is written before release()
+    int err = avformat_alloc_output_context2(&fmt_, nullptr, nullptr, output_.c_str());
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not create output '" << output_ << "': " << av_error_string(err) << std::endl;
+        return;
+    }
+    ctx_ = open_codec(conf, fmt_->oformat, true);
+    frame_ = av_frame_alloc();
+    pkt_ = av_packet_alloc();
+    if (ctx_ == nullptr || frame_ == nullptr || pkt_ == nullptr) {
+        close();
+        return;
+    }
+    frame_->format = ctx_->pix_fmt;
+    frame_->width = ctx_->width;
+    frame_->height = ctx_->height;
+    if (av_frame_get_buffer(frame_, 0) < 0) {
+        close();
+        return;
+    }
+    current_.settings = RenderManifest::settings_for(conf);
+    read_previous(RenderManifest::path_for(output_));
+    opened_ = true;
+}
+
+IncrementalEncoder::~IncrementalEncoder() {
+    release();
+}
+
+// keeps the packets of every page of the previous render that can be copied
+void IncrementalEncoder::read_previous(const std::string &manifest_path) {
+    if (!previous_.load(manifest_path) || !std::filesystem::exists(output_)) {
+        return;
+    }
+    if (previous_.settings != current_.settings) {
+        if (verbose_) {
+            std::cout << "Settings changed since the last render, encoding every page." << std::endl;
+        }
+        return;
+    }
+    AVFormatContext *in = nullptr;
+    if (avformat_open_input(&in, output_.c_str(), nullptr, nullptr) < 0) {
+        return;
+    }
+    // the chapters are a text stream of their own
+    int video = avformat_find_stream_info(in, nullptr) >= 0 ? av_find_best_stream(in, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0) : -1;
+    if (video >= 0) {
+        AVStream *stream = in->streams[video];
+        const AVCodecParameters *par = stream->codecpar;
+        // packets only decode with the parameter sets they were encoded with
+        bool same = par->codec_id == ctx_->codec_id && par->width == ctx_->width && par->height == ctx_->height &&
+                    par->extradata_size == ctx_->extradata_size &&
+                    (ctx_->extradata_size == 0 || std::memcmp(par->extradata, ctx_->extradata, ctx_->extradata_size) == 0);
+        if (same) {
+            std::map<int64_t, uint64_t> starts; // first frame -> page key
+            for (const ManifestPage &page : previous_.pages) {
+                starts.emplace(page.start, page.key);
+            }
+            while (av_read_frame(in, pkt_) >= 0) {
+                if (pkt_->stream_index != video) {
+                    av_packet_unref(pkt_);
+                    continue;
+                }
+                auto it = pkt_->pts == AV_NOPTS_VALUE ? starts.end() : starts.find(av_rescale_q(pkt_->pts, stream->time_base, ctx_->time_base));
+                if (it != starts.end() && (pkt_->flags & AV_PKT_FLAG_KEY) && reusable_.count(it->second) == 0) {
+                    reusable_[it->second] = av_packet_clone(pkt_);
+                }
+                av_packet_unref(pkt_);
+            }
+        } else {
+            std::cerr << "<!> Warning: '" << output_ << "' was encoded differently, encoding every page." << std::endl;
+        }
+    }
+    avformat_close_input(&in);
+}
+
+void IncrementalEncoder::add_page(uint64_t key) {
+    current_.add(ManifestPage{key, next_pts_, 1});
+    titles_.push_back(title_);
+    title_ = "";
+    next_pts_++;
+}
+
+bool IncrementalEncoder::begin_page(uint64_t key) {
+    if (!opened_) {
+        return false;
+    }
+    if (!has_page(key)) {
+        key_ = key;
+        return false;
+    }
+    add_page(key);
+    return true;
+}
+
+// encodes one page as an IDR frame, its packets are kept until release()
+void IncrementalEncoder::send(AVFrame *frame) {
+    if (frame != nullptr) {
+        frame->pts = next_pts_;
+        frame->pict_type = AV_PICTURE_TYPE_I;
+        add_page(key_);
+        key_ = 0;
+    }
+    int err = avcodec_send_frame(ctx_, frame);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not encode frame: " << av_error_string(err) << std::endl;
+        return;
+    }
+    while (avcodec_receive_packet(ctx_, pkt_) == 0) {
+        encoded_[pkt_->pts] = av_packet_clone(pkt_);
+        av_packet_unref(pkt_);
+    }
+}
+
+void IncrementalEncoder::write(const cv::Mat &frame) {
+    if (!opened_ || av_frame_make_writable(frame_) < 0) {
+        return;
+    }
+    if (key_ == 0) {
+        key_ = hash_frame(frame);
+    }
+    if (frame.channels() == 1) {
+        write_gray_frame(frame, frame_);
+        send(frame_);
+        return;
+    }
+    sws_ = sws_getCachedContext(sws_, frame.cols, frame.rows, AV_PIX_FMT_BGR24,
+                                ctx_->width, ctx_->height, AV_PIX_FMT_YUV420P,
+                                SWS_BILINEAR, nullptr, nullptr, nullptr);
+    const uint8_t *src[1] = {frame.data};
+    const int stride[1] = {(int)frame.step[0]};
+    sws_scale(sws_, src, stride, 0, frame.rows, frame_->data, frame_->linesize);
+    send(frame_);
+}
+
+void IncrementalEncoder::write_i420(const cv::Mat &yuv) {
+    if (!opened_ || av_frame_make_writable(frame_) < 0) {
+        return;
+    }
+    if (key_ == 0) {
+        key_ = hash_frame(yuv);
+    }
+    int w = ctx_->width;
+    int h = ctx_->height;
+    const uint8_t *y = yuv.data;
+    const uint8_t *u = y + (size_t)w * h;
+    const uint8_t *v = u + (size_t)(w / 2) * (h / 2);
+    av_image_copy_plane(frame_->data[0], frame_->linesize[0], y, w, w, h);
+    av_image_copy_plane(frame_->data[1], frame_->linesize[1], u, w / 2, w / 2, h / 2);
+    av_image_copy_plane(frame_->data[2], frame_->linesize[2], v, w / 2, w / 2, h / 2);
+    send(frame_);
+}
+
+// every page is one packet, holding only makes it longer
+void IncrementalEncoder::hold(int64_t frames) {
+    if (!current_.pages.empty() && frames > 0) {
+        current_.pages.back().frames += frames;
+        next_pts_ += frames;
+    }
+}
+
+// writes every page in order, new packets or copied ones, with their final
+// timestamps and durations, then replaces the output and its manifest
+bool IncrementalEncoder::mux() {
+    ScopedTimer timer("remux");
+    std::string tmp = output_ + ".part";
+    AVStream *stream = avformat_new_stream(fmt_, nullptr);
+    if (stream == nullptr) {
+        return false;
+    }
+    avcodec_parameters_from_context(stream->codecpar, ctx_);
+    stream->time_base = ctx_->time_base;
+    stream->avg_frame_rate = ctx_->framerate;
+    for (size_t i = 0; i < current_.pages.size(); i++) {
+        if (titles_[i] != "") {
+            add_chapter(fmt_, ctx_->time_base, current_.pages[i].start, titles_[i]);
+        }
+    }
+    end_chapters(fmt_, next_pts_);
+    int err = 0;
+    if (!(fmt_->oformat->flags & AVFMT_NOFILE)) {
+        err = avio_open(&fmt_->pb, tmp.c_str(), AVIO_FLAG_WRITE);
+        if (err < 0) {
+            std::cerr << "<!> Error: Could not open '" << tmp << "': " << av_error_string(err) << std::endl;
+            return false;
+        }
+    }
+    err = avformat_write_header(fmt_, nullptr);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not write header: " << av_error_string(err) << std::endl;
+        return false;
+    }
+
+    size_t reused = 0;
+    for (const ManifestPage &page : current_.pages) {
+        const AVPacket *src = nullptr;
+        auto enc = encoded_.find(page.start);
+        if (enc != encoded_.end()) {
+            src = enc->second;
+        } else if (has_page(page.key)) {
+            src = reusable_.at(page.key);
+            reused++;
+        }
+        if (src == nullptr || av_packet_ref(pkt_, src) < 0) {
+            std::cerr << "<!> Error: No packet for the page at frame " << page.start << "." << std::endl;
+            continue;
+        }
+        pkt_->pts = page.start;
+        pkt_->dts = page.start;
+        pkt_->duration = page.frames;
+        pkt_->pos = -1;
+        pkt_->stream_index = stream->index;
+        av_packet_rescale_ts(pkt_, ctx_->time_base, stream->time_base);
+        timer.add_bytes(pkt_->size);
+        av_interleaved_write_frame(fmt_, pkt_);
+    }
+    av_write_trailer(fmt_);
+    if (!(fmt_->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&fmt_->pb);
+    }
+
+    std::error_code rename_err;
+    std::filesystem::rename(tmp, output_, rename_err);
+    if (rename_err) {
+        std::cerr << "<!> Error: Could not replace '" << output_ << "': " << rename_err.message() << std::endl;
+        return false;
+    }
+    if (!current_.save(RenderManifest::path_for(output_))) {
+        std::cerr << "<!> Warning: Could not write '" << RenderManifest::path_for(output_) << "', the next render will encode every page." << std::endl;
+    }
+    if (verbose_) {
+        std::cout << "Reused " << reused << " of " << current_.pages.size() << " pages." << std::endl;
+    }
+    return true;
+}
+
+void IncrementalEncoder::release() {
+    if (opened_) {
+        send(nullptr);
+        mux();
+        opened_ = false;
+    }
+    close();
+}
+
+void IncrementalEncoder::close() {
+    if (fmt_ != nullptr && fmt_->pb != nullptr && !(fmt_->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&fmt_->pb);
+    }
+    for (auto &[key, packet] : reusable_) {
+        av_packet_free(&packet);
+    }
+    reusable_.clear();
+    for (auto &[pts, packet] : encoded_) {
+        av_packet_free(&packet);
+    }
+    encoded_.clear();
+    sws_freeContext(sws_);
+    sws_ = nullptr;
+    av_packet_free(&pkt_);
+    av_frame_free(&frame_);
+    avcodec_free_context(&ctx_);
+    avformat_free_context(fmt_);
+    fmt_ = nullptr;
+}
+
+// ======== //
+// segments //
+// ======== //
+
+// opens the output with the stream parameters of the first segment
+AVFormatContext *open_concat_output(const std::string &path, const AVStream *src, AVStream *&stream) {
+    AVFormatContext *out = nullptr;
+    int err = avformat_alloc_output_context2(&out, nullptr, nullptr, path.c_str());
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not create output '" << path << "': " << av_error_string(err) << std::endl;
+        return nullptr;
+    }
+    stream = avformat_new_stream(out, nullptr);
+    if (stream == nullptr || avcodec_parameters_copy(stream->codecpar, src->codecpar) < 0) {
+        avformat_free_context(out);
+        return nullptr;
+    }
+    stream->codecpar->codec_tag = 0;
+    stream->time_base = src->time_base;
+    stream->avg_frame_rate = src->avg_frame_rate;
+    if (!(out->oformat->flags & AVFMT_NOFILE)) {
+        err = avio_open(&out->pb, path.c_str(), AVIO_FLAG_WRITE);
+        if (err < 0) {
+            std::cerr << "<!> Error: Could not open '" << path << "': " << av_error_string(err) << std::endl;
+            avformat_free_context(out);
+            return nullptr;
+        }
+    }
+    add_chapter(out, stream->time_base, 0, "");
+    err = avformat_write_header(out, nullptr);
+    if (err < 0) {
+        std::cerr << "<!> Error: Could not write header: " << av_error_string(err) << std::endl;
+        if (!(out->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&out->pb);
+        }
+        avformat_free_context(out);
+        return nullptr;
+    }
+    return out;
+}
+
+// Each segment is shifted to start where the previous one ended (its last
+// pts plus duration), so held slideshow pages and skipped pages line up.
+// So are its chapters, the untitled first one of a segment without a
+// page start is left out.
+bool concat_segments(Config &conf, const std::vector<std::string> &paths) {
+    ScopedTimer timer("concat");
+    AVFormatContext *out = nullptr;
+    AVStream *stream = nullptr;
+    AVPacket *pkt = av_packet_alloc();
+    int64_t offset = 0; // in the output stream's time base
+    bool ok = pkt != nullptr;
+    for (size_t i = 0; ok && i < paths.size(); i++) {
+        AVFormatContext *in = nullptr;
+        int video = -1;
+        if (avformat_open_input(&in, paths[i].c_str(), nullptr, nullptr) >= 0 && avformat_find_stream_info(in, nullptr) >= 0) {
+            video = av_find_best_stream(in, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        }
+        if (video < 0) {
+            std::cerr << "<!> Error: Could not read segment '" << paths[i] << "'." << std::endl;
+            avformat_close_input(&in);
+            ok = false;
+            break;
+        }
+        const AVStream *src = in->streams[video];
+        if (out == nullptr) {
+            out = open_concat_output(conf.get_output(), src, stream);
+            ok = out != nullptr;
+        } else {
+            // packets only decode with the parameter sets they were encoded with
+            const AVCodecParameters *a = stream->codecpar;
+            const AVCodecParameters *b = src->codecpar;
+            ok = a->codec_id == b->codec_id && a->extradata_size == b->extradata_size &&
+                 (a->extradata_size == 0 || std::memcmp(a->extradata, b->extradata, a->extradata_size) == 0);
+            if (!ok) {
+                std::cerr << "<!> Error: Segment '" << paths[i] << "' was encoded differently." << std::endl;
+            }
+        }
+        for (unsigned int c = 0; ok && c < in->nb_chapters; c++) {
+            const AVChapter *ch = in->chapters[c];
+            const AVDictionaryEntry *title = av_dict_get(ch->metadata, "title", nullptr, 0);
+            if (title != nullptr && title->value[0] != '\0') {
+                add_chapter(out, stream->time_base, av_rescale_q(ch->start, ch->time_base, stream->time_base) + offset, title->value);
+            }
+        }
+        int64_t end = 0;
+        while (ok && av_read_frame(in, pkt) >= 0) {
+            if (pkt->stream_index != video) {
+                av_packet_unref(pkt); // chapter text
+                continue;
+            }
+            av_packet_rescale_ts(pkt, src->time_base, stream->time_base);
+            end = std::max(end, pkt->pts + pkt->duration);
+            pkt->pts += offset;
+            pkt->dts += offset;
+            pkt->pos = -1;
+            pkt->stream_index = stream->index;
+            timer.add_bytes(pkt->size);
+            if (av_interleaved_write_frame(out, pkt) < 0) {
+                std::cerr << "<!> Error: Could not write '" << conf.get_output() << "'." << std::endl;
+                ok = false;
+            }
+        }
+        offset += end;
+        avformat_close_input(&in);
+    }
+    if (out != nullptr) {
+        if (ok) {
+            end_chapters(out, offset);
+            av_write_trailer(out);
+        }
+        if (!(out->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&out->pb);
+        }
+        avformat_free_context(out);
+    }
+    av_packet_free(&pkt);
+    return ok;
+}
+
+#endif
+
+std::unique_ptr<Encoder> open_encoder(Config &conf) {
+    if (conf.get_stream() && conf.get_incremental()) {
+        std::cerr << "<!> Warning: --incremental is ignored with --stream." << std::endl;
+    }
+#ifdef PTV_WITH_LIBAV
+    if (conf.get_stream()) {
+        return std::make_unique<AvEncoder>(conf);
+    }
+    if (conf.get_incremental() && conf.get_style() == FRAMES) {
+        auto inc = std::make_unique<IncrementalEncoder>(conf);
+        if (inc->is_opened()) {
+            return inc;
+        }
+        std::cerr << "<!> Warning: Incremental encoding is not available, encoding every page." << std::endl;
+    }
+#else
+    if (conf.get_incremental()) {
+        std::cerr << "<!> Warning: --incremental needs ptv built with libav, encoding every page." << std::endl;
+    }
+#endif
+    if (conf.get_incremental() && conf.get_style() != FRAMES) {
+        std::cerr << "<!> Warning: --incremental only applies to slideshows, encoding every frame." << std::endl;
+    }
+#ifdef PTV_WITH_LIBAV
+    auto av = std::make_unique<AvEncoder>(conf);
+    if (av->is_opened()) {
+        return av;
+    }
+    std::cerr << "<!> Warning: Falling back to OpenCV's video writer." << std::endl;
+#endif
+    return std::make_unique<CvEncoder>(conf);
+}
+
+bool segments_supported() {
+#ifdef PTV_WITH_LIBAV
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool stream_supported() {
+#ifdef PTV_WITH_LIBAV
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<Encoder> open_segment_encoder(Config &conf, const std::string &path) {
+#ifdef PTV_WITH_LIBAV
+    auto av = std::make_unique<AvEncoder>(conf, path);
+    if (av->is_opened()) {
+        return av;
+    }
+#else
+    (void)conf;
+    (void)path;
+#endif
+    return nullptr;
+}
+
+#ifndef PTV_WITH_LIBAV
+bool concat_segments(Config &conf, const std::vector<std::string> &paths) {
+    (void)conf;
+    (void)paths;
+    std::cerr << "<!> Error: Joining segments needs ptv built with libav." << std::endl;
+    return false;
+}
+#endif
+
+}
@@ -0,0 +1,211 @@
+#ifndef PTV_ENCODER_HPP
+#define PTV_ENCODER_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "manifest.hpp"
+#include "opencv.hpp"
+#include "ptv.hpp"
+
+#ifdef PTV_WITH_LIBAV
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct SwsContext;
+#endif
+
+namespace ptv {
+
+// Where finished frames go. Frames are at the video resolution.
+class Encoder {
+    public:
+        virtual ~Encoder() {}
+
+        virtual bool is_opened() = 0;
+
+        // true if write_i420() is cheaper than write()
+        virtual bool prefers_i420() { return false; }
+
+        // 3 channel BGR frame, or single channel gray
+        virtual void write(const cv::Mat &frame) = 0;
+
+        // planar YUV 4:2:0 frame in OpenCV's I420 layout
+        // (CV_8UC1, height * 3 / 2 rows: Y plane, then U, then V)
+        virtual void write_i420(const cv::Mat &yuv) = 0;
+
+        // keeps showing the last written frame for `frames` more frame
+        // durations (slideshow pages). The frame must stay valid until the
+        // next write.
+        virtual void hold(int64_t frames) = 0;
+
+        // --incremental: the next page has content `key`. Returns true if
+        // the page is copied from the previous output instead, it is then
+        // only held, not written.
+        virtual bool begin_page(uint64_t key) { return false; }
+
+        // true if begin_page(key) would reuse the page, safe from any thread.
+        // loaders use it to skip pages that will not be encoded.
+        virtual bool has_page(uint64_t key) const { return false; }
+
+        // the next written frame starts a page: it is encoded as a keyframe
+        // (an IDR frame), so seeking to the page decodes that one frame, and
+        // starts an mp4 chapter called `title`. Repeated before the same
+        // frame, the last title counts.
+        virtual void mark_page(const std::string &title) {}
+
+        // --stream: everything written so far goes out to the output now,
+        // as one fragment. Called after every page.
+        virtual void flush() {}
+
+        // flushes and finalizes the file
+        virtual void release() = 0;
+};
+
+// Fallback encoder through cv::VideoWriter. Only the codec can be chosen,
+// OpenCV does the BGR to YUV conversion. Keyframes are the codec's own
+// and there are no chapters.
+class CvEncoder : public Encoder {
+    cv::VideoWriter vid_;
+    cv::Mat bgr_;  // reused by write_i420()
+    cv::Mat last_; // repeated by hold()
+
+    public:
+        CvEncoder(Config &conf);
+        bool is_opened() override { return vid_.isOpened(); }
+        void write(const cv::Mat &frame) override;
+        void write_i420(const cv::Mat &yuv) override;
+        void hold(int64_t frames) override;
+        void release() override { vid_.release(); }
+};
+
+#ifdef PTV_WITH_LIBAV
+// Native libavcodec/libavformat encoder. Supports libx264, libx265 and
+// SVT-AV1 with crf, preset, thread count and gop size, and takes YUV 4:2:0
+// frames without another conversion.
+//
+// A frame is only sent once the next one arrives, so hold() just makes it
+// last longer. Held pages are encoded once with a longer duration
+// (variable frame rate) instead of being repeated.
+//
+// With --stream the output is fragmented mp4 (an empty moov, then a
+// moof/mdat pair per flush()) and x264/x265 are tuned for zero latency,
+// so a page is readable as soon as it is encoded. "-" is stdout.
+//
+// Pages marked with mark_page() start on an IDR frame, with the long
+// default GOP (DEFAULT_GOP_SECONDS) in between, and their chapters are
+// written on release() (not with --stream, the moov went out first).
+class AvEncoder : public Encoder {
+    bool opened_ = false;
+    bool streaming_ = false;  // --stream
+    bool mark_ = false;       // the next frame starts a page
+    std::string title_ = "";  // its chapter
+    int64_t next_pts_ = 0;
+    int64_t pending_ = 0; // frame durations frame_ is shown for, 0 = nothing waiting
+    AVFormatContext *fmt_ = nullptr;
+    AVCodecContext *ctx_ = nullptr;
+    AVStream *stream_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *pkt_ = nullptr;
+    SwsContext *sws_ = nullptr;
+
+    bool next_frame();
+    void send(AVFrame *frame, int64_t duration);
+    void flush_pending();
+    void close();
+
+    public:
+        AvEncoder(Config &conf, const std::string &path = ""); // path defaults to the output
+        ~AvEncoder();
+        AvEncoder(const AvEncoder &) = delete;
+        AvEncoder &operator=(const AvEncoder &) = delete;
+
+        bool is_opened() override { return opened_; }
+        bool prefers_i420() override { return true; }
+        void write(const cv::Mat &frame) override;
+        void write_i420(const cv::Mat &yuv) override;
+        void hold(int64_t frames) override { pending_ += pending_ > 0 ? frames : 0; }
+        void mark_page(const std::string &title) override;
+        void flush() override;
+        void release() override;
+};
+
+// Incremental slideshow encoder (--incremental). Every page is encoded as
+// a single IDR frame, so each page is its own closed GOP. A manifest next
+// to the output records each page's content key and frame range, and each
+// page is a chapter.
+//
+// On a rerun with the same settings, pages whose key is in the previous
+// manifest are not encoded again: their packets are stream-copied out of
+// the previous video. Only new or changed pages go through the encoder.
+// The previous video's packets are read into memory up front, and the
+// new file is muxed on release() under a temporary name, then renamed
+// over the output.
+class IncrementalEncoder : public Encoder {
+    bool opened_ = false;
+    bool verbose_ = false;
+    std::string output_ = "";
+    int64_t next_pts_ = 0;
+    uint64_t key_ = 0; // key of the next written page, 0 = hash the frame
+    std::string title_ = "";            // chapter of the next page
+    std::vector<std::string> titles_;   // chapter of each page of current_
+    RenderManifest previous_;
+    RenderManifest current_;
+    std::unordered_map<uint64_t, AVPacket *> reusable_; // previous packets by page key
+    std::map<int64_t, AVPacket *> encoded_;             // new packets by pts
+    AVFormatContext *fmt_ = nullptr; // only used to pick the container
+    AVCodecContext *ctx_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    AVPacket *pkt_ = nullptr;
+    SwsContext *sws_ = nullptr;
+
+    void read_previous(const std::string &manifest_path);
+    void add_page(uint64_t key);
+    void send(AVFrame *frame);
+    bool mux();
+    void close();
+
+    public:
+        IncrementalEncoder(Config &conf);
+        ~IncrementalEncoder();
+        IncrementalEncoder(const IncrementalEncoder &) = delete;
+        IncrementalEncoder &operator=(const IncrementalEncoder &) = delete;
+
+        bool is_opened() override { return opened_; }
+        bool prefers_i420() override { return true; }
+        void write(const cv::Mat &frame) override;
+        void write_i420(const cv::Mat &yuv) override;
+        void hold(int64_t frames) override;
+        void mark_page(const std::string &title) override { title_ = title; }
+        bool begin_page(uint64_t key) override;
+        bool has_page(uint64_t key) const override { return reusable_.count(key) > 0; }
+        void release() override;
+};
+#endif
+
+// returns the libav encoder when it is built in and the codec is available,
+// otherwise the cv::VideoWriter fallback. Slideshows with --incremental
+// get the IncrementalEncoder when libav is built in. --stream always
+// gets the AvEncoder, see stream_supported().
+std::unique_ptr<Encoder> open_encoder(Config &conf);
+
+// --stream needs libav, OpenCV's writer can only write whole files
+bool stream_supported();
+
+// --segments: parts of the video are encoded at the same time, each into
+// its own file at `path`, then concat_segments() copies their packets into
+// the output one after the other. Every segment starts with a keyframe and
+// is encoded with the same settings, so nothing is re-encoded, and their
+// chapters are shifted along with their packets. Needs libav,
+// open_segment_encoder() returns null without it.
+bool segments_supported();
+std::unique_ptr<Encoder> open_segment_encoder(Config &conf, const std::string &path);
+bool concat_segments(Config &conf, const std::vector<std::string> &paths);
+
+}
+#endif
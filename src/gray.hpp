@@ -0,0 +1,74 @@
+#ifndef PTV_GRAY_HPP
+#define PTV_GRAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "blend.hpp"
+#include "opencv.hpp"
+
+namespace ptv {
+
+// Monochrome page detection. Text documents usually render with B == G == R
+// in every pixel, those pages are kept single channel (CV_8UC1) from the
+// renderer to the encoder: a third of the bytes to convert, scale, queue,
+// compose and blend, and no chroma to compute.
+//
+// The SSE2 kernel tests 4 BGRA pixels (poppler's argb32) per iteration,
+// the scan stops at the first row with any color.
+
+inline bool is_gray_span_scalar(const uint8_t *p, size_t n, int cn) {
+    for (size_t i = 0; i < n; i++, p += cn) {
+        if (p[0] != p[1] || p[1] != p[2]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef PTV_BLEND_X86
+__attribute__((target("sse2")))
+inline bool is_gray_bgra_sse2(const uint8_t *p, size_t n) {
+    // B ^ G and G ^ R land in the low two bytes of each pixel
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    __m128i diff = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 4 * i));
+        diff = _mm_or_si128(diff, _mm_xor_si128(v, _mm_srli_epi32(v, 8)));
+    }
+    diff = _mm_and_si128(diff, mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    return is_gray_span_scalar(p + 4 * i, n - i, 4);
+}
+#endif
+
+// true if `img` (CV_8UC1, CV_8UC3 or CV_8UC4, alpha ignored) has no color
+inline bool is_gray(const cv::Mat &img) {
+    int cn = img.channels();
+    if (cn == 1) {
+        return true;
+    }
+#ifdef PTV_BLEND_X86
+    static const bool sse2 = __builtin_cpu_supports("sse2");
+#endif
+    for (int r = 0; r < img.rows; r++) {
+        const uint8_t *row = img.ptr(r);
+#ifdef PTV_BLEND_X86
+        if (cn == 4 && sse2) {
+            if (!is_gray_bgra_sse2(row, img.cols)) {
+                return false;
+            }
+            continue;
+        }
+#endif
+        if (!is_gray_span_scalar(row, img.cols, cn)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+#endif
@@ -0,0 +1,104 @@
+#include "manifest.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace ptv {
+
+#define MANIFEST_MAGIC "ptv-manifest 1"
+
+std::string RenderManifest::path_for(const std::string &output) {
+    return output + ".ptv";
+}
+
+std::string RenderManifest::settings_for(Config &conf) {
+    std::ostringstream out;
+    out << conf.get_width() << "x" << conf.get_height() << " " << conf.get_fps() << " " << conf.get_codec() << " " << conf.get_crf() << " "
+        << (conf.get_preset() != "" ? conf.get_preset() : "-");
+    return out.str();
+}
+
+bool RenderManifest::load(const std::string &path) {
+    settings = "";
+    pages.clear();
+    by_key_.clear();
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != MANIFEST_MAGIC) {
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        std::string tag;
+        in >> tag;
+        if (tag == "settings") {
+            std::getline(in >> std::ws, settings);
+        } else if (tag == "page") {
+            ManifestPage page;
+            in >> std::hex >> page.key >> std::dec >> page.start >> page.frames;
+            if (!in || page.frames < 1) {
+                pages.clear();
+                by_key_.clear();
+                return false;
+            }
+            add(page);
+        }
+    }
+    return settings != "";
+}
+
+// written under a temporary name and renamed, like the video
+bool RenderManifest::save(const std::string &path) const {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp);
+        file << MANIFEST_MAGIC << "\n";
+        file << "settings " << settings << "\n";
+        for (const ManifestPage &page : pages) {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)page.key);
+            file << "page " << buf << " " << page.start << " " << page.frames << "\n";
+        }
+        if (!file) {
+            return false;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp, path, err);
+    return !err;
+}
+
+void RenderManifest::add(const ManifestPage &page) {
+    by_key_.emplace(page.key, pages.size());
+    pages.push_back(page);
+}
+
+const ManifestPage *RenderManifest::find(uint64_t key) const {
+    auto it = by_key_.find(key);
+    return it == by_key_.end() ? nullptr : &pages[it->second];
+}
+
+uint64_t hash_frame(const cv::Mat &img) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t)img.rows << 32) ^ (uint64_t)img.cols;
+    size_t row_bytes = img.cols * img.elemSize();
+    for (int r = 0; r < img.rows; r++) {
+        const uint8_t *row = img.ptr(r);
+        size_t i = 0;
+        for (; i + 8 <= row_bytes; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, row + i, 8);
+            hash = (hash ^ word) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+        for (; i < row_bytes; i++) {
+            hash = (hash ^ row[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+}
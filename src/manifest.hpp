@@ -0,0 +1,53 @@
+#ifndef PTV_MANIFEST_HPP
+#define PTV_MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "opencv.hpp"
+#include "ptv.hpp"
+
+namespace ptv {
+
+// one page of an incremental render. Every page starts a closed GOP
+// (an IDR frame) at `start`, so its packets can be copied on their own.
+struct ManifestPage {
+    uint64_t key = 0;   // content hash, see Page::key
+    int64_t start = 0;  // first frame
+    int64_t frames = 0; // frames the page is shown for
+};
+
+// Sidecar of an --incremental render, "<output>.ptv" next to the video.
+// A text file:
+//
+//     ptv-manifest 1
+//     settings 1280x720 30 h264 -1 medium
+//     page <key> <start> <frames>
+//     ...
+//
+// The settings line holds everything that changes how a page is encoded.
+// Pages of a previous render are only reused when it matches.
+class RenderManifest {
+    std::unordered_map<uint64_t, size_t> by_key_;
+
+    public:
+        std::string settings = "";
+        std::vector<ManifestPage> pages = {};
+
+        static std::string path_for(const std::string &output);
+        static std::string settings_for(Config &conf);
+
+        // false if missing or unreadable, the manifest is then empty
+        bool load(const std::string &path);
+        bool save(const std::string &path) const;
+
+        void add(const ManifestPage &page);
+        const ManifestPage *find(uint64_t key) const;
+};
+
+// 64 bit hash of a frame's pixels, 8 bytes at a time
+uint64_t hash_frame(const cv::Mat &img);
+
+}
+#endif
@@ -0,0 +1,1382 @@
+#include "pipeline.hpp"
+#include "alloc.hpp"
+#include "compositor.hpp"
+#include "gray.hpp"
+#include "stats.hpp"
+#include "yuv.hpp"
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+template <ptv::Axis A, bool Reverse>
+void scroll_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, const vector<int> &lengths, ptv::Config &conf, const Segment &seg);
+
+// ========= //
+// Functions //
+// ========= //
+
+void scale_image_to_width(cv::Mat &img, int dst_width) {
+    ptv::ScopedTimer timer("scale");
+    float scale = (float)dst_width / (float)img.cols;
+    cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_LINEAR);
+}
+
+void scale_image_to_height(cv::Mat &img, int dst_height) {
+    ptv::ScopedTimer timer("scale");
+    float scale = (float)dst_height / (float)img.rows;
+    cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_LINEAR);
+}
+
+void scale_image_to_scroll(cv::Mat &img, ptv::Config &conf) {
+    if (conf.is_horizontal()) {
+        scale_image_to_height(img, conf.get_height());
+    } else {
+        scale_image_to_width(img, conf.get_width());
+    }
+}
+
+void scale_image_to_fit(cv::Mat &img, ptv::Config &conf) {
+    ptv::ScopedTimer timer("scale");
+    float scale = get_fit_scale(img.cols, img.rows, conf);
+    cv::resize(img, img, cv::Size(), scale, scale, cv::INTER_LINEAR);
+}
+
+float get_fit_scale(int cols, int rows, ptv::Config &conf) {
+    float scale_w;
+    float scale_h;
+    float scale = 1.0;
+    if (cols > conf.get_width() && cols > conf.get_height()) {
+        scale_w = (float)conf.get_width() / (float)cols;
+        scale_h = (float)conf.get_height() / (float)rows;
+        scale = std::min(scale_w, scale_h);
+    }
+    if (cols < conf.get_width() && rows < conf.get_height()) {
+        scale_w = (float)conf.get_width() / (float)cols;
+        scale_h = (float)conf.get_height() / (float)rows;
+        scale = std::min(scale_w, scale_h);
+    }
+    if (cols > conf.get_width() && rows <= conf.get_height()) {
+        scale_w = (float)conf.get_width() / (float)cols;
+        scale = scale_w;
+    }
+    if (cols <= conf.get_width() && rows > conf.get_height()) {
+        scale_h = (float)conf.get_height() / (float)rows;
+        scale = scale_h;
+    }
+    return scale;
+}
+
+cv::Size get_scaled_size(cv::Size size, ptv::Config &conf) {
+    float scale;
+    if (conf.get_style() == FRAMES) {
+        scale = get_fit_scale(size.width, size.height, conf);
+    } else if (conf.is_horizontal()) {
+        scale = (float)conf.get_height() / (float)size.height;
+    } else {
+        scale = (float)conf.get_width() / (float)size.width;
+    }
+    return cv::Size(std::max(1, cvRound(size.width * scale)), std::max(1, cvRound(size.height * scale)));
+}
+
+// page size in points as poppler renders it: the crop box, turned by the page's rotation
+poppler::rectf get_page_rect(poppler::page *page) {
+    poppler::rectf rect = page->page_rect(poppler::crop_box);
+    poppler::page::orientation_enum orientation = page->orientation();
+    if (orientation == poppler::page::landscape || orientation == poppler::page::seascape) {
+        return poppler::rectf(0, 0, rect.height(), rect.width());
+    }
+    return poppler::rectf(0, 0, rect.width(), rect.height());
+}
+
+// pixels `points` take at `dpi`, rounded half up like poppler's output
+int get_rendered_length(double points, float dpi) {
+    return (int)(points * dpi / DEFAULT_DPI + 0.5);
+}
+
+// returns dpi to scale page to viewport width
+float get_scaled_dpi_from_width(poppler::page *page, int width) {
+    auto rect = get_page_rect(page);
+    if (rect.width() == width) {
+        return DEFAULT_DPI;
+    }
+    return ((float)width * DEFAULT_DPI) / (float)rect.width();
+}
+
+// returns dpi to scale page to viewport height
+float get_scaled_dpi_from_height(poppler::page *page, int height) {
+    auto rect = get_page_rect(page);
+    if (rect.height() == height) {
+        return DEFAULT_DPI;
+    }
+    return ((float)height * DEFAULT_DPI) / (float)rect.height();
+}
+
+// returns dpi to scale page across the scroll axis
+float get_scaled_dpi_to_scroll(poppler::page *page, ptv::Config &conf) {
+    if (conf.is_horizontal()) {
+        return get_scaled_dpi_from_height(page, conf.get_height());
+    }
+    return get_scaled_dpi_from_width(page, conf.get_width());
+}
+
+// returns dpi that will scale the pdf page to fit the viewport dimentions
+float get_scaled_dpi_to_fit(poppler::page *page, ptv::Config &conf) {
+    float dpi_w;
+    float dpi_h;
+    poppler::rectf rect = get_page_rect(page);
+    if (rect.width() > conf.get_width() && rect.height() > conf.get_height()) {
+        dpi_w = ((float)conf.get_width() * DEFAULT_DPI) / rect.width();
+        dpi_h = ((float)conf.get_height() * DEFAULT_DPI) / rect.height();
+        return std::min(dpi_w, dpi_h);
+    }
+    if (rect.width() < conf.get_width() && rect.height() < conf.get_height()) {
+        dpi_w = ((float)conf.get_width() * DEFAULT_DPI) / rect.width();
+        dpi_h = ((float)conf.get_height() * DEFAULT_DPI) / rect.height();
+        return std::min(dpi_w, dpi_h);
+    }
+    if (rect.width() > conf.get_width() && rect.height() <= conf.get_height()) {
+        dpi_w = ((float)conf.get_width() * DEFAULT_DPI) / rect.width();
+        return dpi_w;
+    }
+    if (rect.width() <= conf.get_width() && rect.height() > conf.get_height()) {
+        dpi_h = ((float)conf.get_height() * DEFAULT_DPI) / rect.height();
+        return dpi_h;
+    }
+    return DEFAULT_DPI;
+}
+
+// sets video resolution to resolution of first image in the sequence.
+void set_seq_resolution(const ptv::SeqIndex &seq, ptv::Config &conf) {
+    const ptv::SeqImage &first = seq.images[0];
+    if (!first.size.empty()) {
+        conf.set_resolution(first.size);
+        return;
+    }
+    cv::Mat img = cv::imread(first.path);
+    conf.set_resolution(img);
+}
+
+// If -r 0x0, adjusts resolution to fit first page
+void set_pdf_resolution(ptv::Config &conf) {
+    string path = conf.get_pdf_paths()[0];
+    std::unique_ptr<poppler::document> pdf(poppler::document::load_from_file(path));
+    if (pdf == nullptr || pdf->pages() < 1) {
+        throw std::runtime_error("<!> Error: '" + path + "' could not be loaded.");
+    }
+    poppler::page *page = pdf->create_page(0);
+    poppler::rectf rect = get_page_rect(page);
+    conf.set_resolution(rect);
+    delete page;
+}
+
+// returns image lengths along the scroll axis after scale_image_to_scroll(), used to find the scroll speed
+vector<int> get_seq_image_lengths(const ptv::SeqIndex &seq, ptv::Config &conf) {
+    vector<int> lengths = {};
+    for (const ptv::SeqImage &img : seq.images) {
+        cv::Size size = img.size;
+        if (size.empty()) {
+            cv::Mat mat = cv::imread(img.path);
+            if (mat.empty()) {
+                continue;
+            }
+            size = mat.size();
+        }
+        cv::Size scaled = get_scaled_size(size, conf);
+        int len = conf.is_horizontal() ? scaled.width : scaled.height;
+        lengths.push_back(len % 2 != 0 ? len + 1 : len);
+    }
+    return lengths;
+}
+
+// returns page lengths along the scroll axis at the dpi used by load_pdf_images(), without rendering them.
+// they are the rows (or columns) poppler will render, --segments origins are summed from them.
+vector<int> get_pdf_page_lengths(ptv::Config &conf) {
+    vector<int> lengths = {};
+    for (const string &path : conf.get_pdf_paths()) {
+        poppler::document *pdf = poppler::document::load_from_file(path);
+        if (pdf == nullptr) {
+            continue;
+        }
+        for (int pg = 0; pg < pdf->pages(); pg++) {
+            poppler::page *page = pdf->create_page(pg);
+            float dpi = get_scaled_dpi_to_scroll(page, conf);
+            poppler::rectf rect = get_page_rect(page);
+            lengths.push_back(get_rendered_length(conf.is_horizontal() ? rect.width() : rect.height(), dpi));
+            delete page;
+        }
+        delete pdf;
+    }
+    return lengths;
+}
+
+// number of pages load_pdf_images() or load_seq_images() will load
+size_t get_page_count(const ptv::SeqIndex &seq, ptv::Config &conf) {
+    size_t count = 0;
+    if (conf.get_is_pdf()) {
+        for (const string &path : conf.get_pdf_paths()) {
+            poppler::document *pdf = get_thread_document(path);
+            count += pdf != nullptr ? pdf->pages() : 0;
+        }
+    } else {
+        count = seq.size();
+    }
+    return count;
+}
+
+// decodes an image already scaled and padded for the video, empty if it could not be read.
+// jpegs are decoded at 1/2, 1/4 or 1/8 scale when the result is still at least the output size.
+// gray files stay single channel. the header was already read by the index.
+cv::Mat read_seq_image(const ptv::SeqImage &img, ptv::Config &conf) {
+    const string &path = img.path;
+    cv::Size size = img.size;
+    bool gray = img.gray;
+    bool known = !size.empty();
+    int reduce = 1;
+    int flags = gray ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+    string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (known && (ext == ".jpg" || ext == ".jpeg")) {
+        cv::Size target = get_scaled_size(size, conf);
+        const std::pair<int, int> reduced[] = {{8, cv::IMREAD_REDUCED_COLOR_8}, {4, cv::IMREAD_REDUCED_COLOR_4}, {2, cv::IMREAD_REDUCED_COLOR_2}};
+        const std::pair<int, int> reduced_gray[] = {{8, cv::IMREAD_REDUCED_GRAYSCALE_8}, {4, cv::IMREAD_REDUCED_GRAYSCALE_4}, {2, cv::IMREAD_REDUCED_GRAYSCALE_2}};
+        for (int i = 0; i < 3; i++) {
+            const auto &[factor, flag] = gray ? reduced_gray[i] : reduced[i];
+            if (size.width / factor >= target.width && size.height / factor >= target.height) {
+                reduce = factor;
+                flags = flag;
+                break;
+            }
+        }
+    }
+    cv::Mat mat;
+    {
+        ptv::ScopedTimer timer("decode");
+        mat = cv::imread(path, flags);
+        timer.add_bytes(mat.total() * mat.elemSize());
+    }
+    if (mat.empty()) {
+        return mat;
+    }
+    // reduced decodes round up, the header has the exact source size
+    cv::Size source = known ? size : mat.size();
+    if (conf.get_i420()) {
+        // scale, letterbox and convert in one pass
+        ptv::ScopedTimer timer("scale");
+        cv::Mat yuv;
+        letterbox_to_i420(mat, get_scaled_size(source, conf), yuv, conf.get_width(), conf.get_height());
+        timer.add_bytes(yuv.total());
+        return yuv;
+    }
+
+    // Resizes straight into the letterboxed frame (slideshow) or the padded
+    // buffer (scroll), no extra copy.
+    // Makes dimentions of the image divisible by 2.
+    // ffmpeg will get upset if otherwise.
+    cv::Size scaled = get_scaled_size(source, conf);
+    cv::Mat dst;
+    cv::Rect2i box;
+    if (conf.get_style() == FRAMES && conf.get_letterbox()) {
+        dst = cv::Mat(conf.get_height(), conf.get_width(), mat.type());
+        box = get_letterbox_roi(scaled, dst.size());
+        scaled = box.size();
+    } else {
+        int rows = scaled.height % 2 != 0 ? scaled.height + 1 : scaled.height;
+        int cols = scaled.width % 2 != 0 ? scaled.width + 1 : scaled.width;
+        dst = cv::Mat(rows, cols, mat.type());
+        box = cv::Rect2i(0, 0, scaled.width, scaled.height);
+    }
+    fill_letterbox(dst, box);
+    cv::Mat roi = dst(box);
+    ptv::ScopedTimer timer("scale");
+    timer.add_bytes(dst.total() * dst.elemSize());
+    if (scaled == mat.size()) {
+        mat.copyTo(roi);
+    } else {
+        cv::resize(mat, roi, scaled, 0, 0, cv::INTER_LINEAR);
+    }
+    return dst;
+}
+
+// decodes the indexed images on the thread pool and queues them in sequence order.
+// the queue depth is how far decoding runs ahead of the encoder.
+// with --incremental, images `reuse` already has are queued without being decoded.
+// only images in `range` are loaded, queued from 0.
+void load_seq_images(const ptv::SeqIndex &seq, ptv::Config &conf, ptv::ThreadPool &pool, ptv::BoundedQueue<ptv::Page> &pages,
+                     const ptv::Encoder *reuse, PageRange range) {
+    ptv::WaitGroup decoding;
+    size_t last = std::min(range.last, seq.size());
+    for (size_t n = range.first; n < last; n++) {
+        size_t index = n - range.first;
+        // queue was closed by the video generator
+        if (!pages.reserve(index)) {
+            break;
+        }
+        decoding.add();
+        pool.submit([&conf, &pages, &decoding, reuse, &img = seq.images[n], index] {
+            const string &path = img.path;
+            string title = fs::path(path).stem().string();
+            uint64_t key = conf.get_incremental() ? ptv::PageCache::hash_file(path) : 0;
+            if (reuse != nullptr && reuse->has_page(key)) {
+                pages.put(index, ptv::Page{index, cv::Mat(), key, false, title});
+                decoding.done();
+                return;
+            }
+            cv::Mat mat;
+            try {
+                mat = read_seq_image(img, conf);
+            } catch (cv::Exception &e) {
+                std::cerr << "<!> Exception: " << e.msg << "\nLine: " << e.line << std::endl;
+            }
+            if (mat.empty()) {
+                std::cerr << "<!> Error: '" << path << "' could not be read. Skipped." << std::endl;
+                pages.skip(index);
+            } else {
+                pages.put(index, ptv::Page{index, mat, key, false, title});
+            }
+            decoding.done();
+        });
+    }
+    decoding.wait();
+}
+
+// Scales pages to correctly fit inside video resolution.
+float get_page_dpi(poppler::page *page, ptv::Config &conf) {
+    if (conf.get_style() == FRAMES) {
+        return get_scaled_dpi_to_fit(page, conf);
+    }
+    return get_scaled_dpi_to_scroll(page, conf);
+}
+
+// where a page sits in the frame: centered, clipped if it is bigger
+cv::Rect2i get_letterbox_roi(cv::Size page, cv::Size frame) {
+    int w = std::min(page.width, frame.width);
+    int h = std::min(page.height, frame.height);
+    int x = frame.width - w >= 2 ? (frame.width - w) / 2 : 0;
+    int y = frame.height - h >= 2 ? (frame.height - h) / 2 : 0;
+    return cv::Rect2i(x, y, w, h);
+}
+
+// blacks out everything in `frame` around `roi`
+void fill_letterbox(cv::Mat &frame, const cv::Rect2i &roi) {
+    const cv::Scalar black(0, 0, 0);
+    frame.rowRange(0, roi.y).setTo(black);
+    frame.rowRange(roi.y + roi.height, frame.rows).setTo(black);
+    cv::Mat band = frame.rowRange(roi.y, roi.y + roi.height);
+    band.colRange(0, roi.x).setTo(black);
+    band.colRange(roi.x + roi.width, frame.cols).setTo(black);
+}
+
+// a video frame with `img` letterboxed in it, one copy
+cv::Mat letterbox_page(const cv::Mat &img, ptv::Config &conf) {
+    cv::Mat frame(conf.get_height(), conf.get_width(), img.type());
+    cv::Rect2i roi = get_letterbox_roi(img.size(), frame.size());
+    fill_letterbox(frame, roi);
+    img(cv::Rect2i(0, 0, roi.width, roi.height)).copyTo(frame(roi));
+    return frame;
+}
+
+// CV_8UC1 if the rendered page has no color (see gray.hpp), CV_8UC3 otherwise
+int get_page_type(const poppler::image &img) {
+    void *data = (void *)img.const_data();
+    if (img.format() == poppler::image::format_gray8) {
+        return CV_8UC1;
+    } else if (data == nullptr) {
+        return CV_8UC3;
+    } else if (img.format() == poppler::image::format_argb32) {
+        return ptv::is_gray(cv::Mat(img.height(), img.width(), CV_8UC4, data, img.bytes_per_row())) ? CV_8UC1 : CV_8UC3;
+    } else if (img.format() == poppler::image::format_rgb24 || img.format() == poppler::image::format_bgr24) {
+        return ptv::is_gray(cv::Mat(img.height(), img.width(), CV_8UC3, data, img.bytes_per_row())) ? CV_8UC1 : CV_8UC3;
+    }
+    return CV_8UC3;
+}
+
+// converts poppler's buffer to BGR, or gray if `dst` is single channel, straight
+// into `dst` (same size), one vectorized pass.
+// returns false for formats that are not handled.
+bool convert_page_image(const poppler::image &img, cv::Mat dst) {
+    // poppler's buffer is only read
+    void *data = (void *)img.const_data();
+    if (data == nullptr) {
+        return false;
+    }
+    cv::Rect2i roi(0, 0, dst.cols, dst.rows);
+    if (dst.channels() == 1) {
+        // any channel of a gray page will do
+        if (img.format() == poppler::image::format_gray8) {
+            cv::Mat src(img.height(), img.width(), CV_8UC1, data, img.bytes_per_row());
+            src(roi).copyTo(dst);
+        } else if (img.format() == poppler::image::format_rgb24 || img.format() == poppler::image::format_bgr24) {
+            cv::Mat src(img.height(), img.width(), CV_8UC3, data, img.bytes_per_row());
+            cv::extractChannel(src(roi), dst, 0);
+        } else if (img.format() == poppler::image::format_argb32) {
+            cv::Mat src(img.height(), img.width(), CV_8UC4, data, img.bytes_per_row());
+            cv::extractChannel(src(roi), dst, 0);
+        } else {
+            return false;
+        }
+    } else if (img.format() == poppler::image::format_gray8) {
+        cv::Mat src(img.height(), img.width(), CV_8UC1, data, img.bytes_per_row());
+        cv::cvtColor(src(roi), dst, cv::COLOR_GRAY2BGR);
+    } else if (img.format() == poppler::image::format_rgb24) {
+        cv::Mat src(img.height(), img.width(), CV_8UC3, data, img.bytes_per_row());
+        cv::cvtColor(src(roi), dst, cv::COLOR_RGB2BGR);
+    } else if (img.format() == poppler::image::format_bgr24) {
+        cv::Mat src(img.height(), img.width(), CV_8UC3, data, img.bytes_per_row());
+        src(roi).copyTo(dst);
+    } else if (img.format() == poppler::image::format_argb32) {
+        // little endian argb32 is B, G, R, A in memory
+        cv::Mat src(img.height(), img.width(), CV_8UC4, data, img.bytes_per_row());
+        cv::cvtColor(src(roi), dst, cv::COLOR_BGRA2BGR);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Renders a page as a 3 channel BGR image, or gray if it has no color, empty
+// if it could not be rendered.
+// In slideshow mode the page is converted straight into a letterboxed video
+// frame, so nothing touches it again before the encoder. `view` is set to
+// the page's own pixels (the whole image when scrolling, or when pages are
+// shared between renditions).
+cv::Mat render_pdf_page(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf, cv::Mat &view) {
+    poppler::image img;
+    {
+        ptv::ScopedTimer timer("render");
+        img = renderer.render_page(page, dpi, dpi);
+    }
+    cv::Mat mat;
+    if (img.data() == nullptr || img.format() == poppler::image::format_invalid) {
+        return mat;
+    }
+    ptv::ScopedTimer timer("convert");
+    int type = get_page_type(img);
+    if (conf.get_style() == FRAMES && conf.get_letterbox()) {
+        mat = cv::Mat(conf.get_height(), conf.get_width(), type);
+        cv::Rect2i roi = get_letterbox_roi(cv::Size(img.width(), img.height()), mat.size());
+        fill_letterbox(mat, roi);
+        view = mat(roi);
+    } else {
+        mat = cv::Mat(img.height(), img.width(), type);
+        view = mat;
+    }
+    if (!convert_page_image(img, view)) {
+        view.release();
+        return cv::Mat();
+    }
+    timer.add_bytes(mat.total() * mat.elemSize());
+    return mat;
+}
+
+// Renders a page as a whole I420 slideshow frame. argb32 and bgr24 output
+// is scaled, letterboxed and converted straight out of poppler's buffer.
+// Gray pages are reduced to one channel first, only luma is computed.
+cv::Mat render_pdf_i420(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf) {
+    poppler::image img;
+    {
+        ptv::ScopedTimer timer("render");
+        img = renderer.render_page(page, dpi, dpi);
+    }
+    if (img.const_data() == nullptr || img.format() == poppler::image::format_invalid) {
+        return cv::Mat();
+    }
+    ptv::ScopedTimer timer("convert");
+    void *data = (void *)img.const_data();
+    cv::Mat src;
+    if (get_page_type(img) == CV_8UC1) {
+        src = cv::Mat(img.height(), img.width(), CV_8UC1);
+        if (!convert_page_image(img, src)) {
+            return cv::Mat();
+        }
+    } else if (img.format() == poppler::image::format_argb32) {
+        src = cv::Mat(img.height(), img.width(), CV_8UC4, data, img.bytes_per_row());
+    } else if (img.format() == poppler::image::format_bgr24) {
+        src = cv::Mat(img.height(), img.width(), CV_8UC3, data, img.bytes_per_row());
+    } else {
+        src = cv::Mat(img.height(), img.width(), CV_8UC3);
+        if (!convert_page_image(img, src)) {
+            return cv::Mat();
+        }
+    }
+    cv::Mat yuv;
+    letterbox_to_i420(src, src.size(), yuv, conf.get_width(), conf.get_height());
+    timer.add_bytes(yuv.total());
+    return yuv;
+}
+
+int get_band_length(ptv::Config &conf) {
+    return SCROLL_BAND_VIEWPORTS * (conf.is_horizontal() ? conf.get_width() : conf.get_height());
+}
+
+// Ordinary pages are rendered whole, so they go through the page cache.
+// Only pages whose BGR pixels would pass SCROLL_BAND_MAX_MB, or an eighth
+// of --memory, are banded.
+int get_band_threshold(ptv::Config &conf) {
+    size_t cap = (size_t)SCROLL_BAND_MAX_MB << 20;
+    if (conf.get_memory_mb() > 0) {
+        cap = std::min(cap, ((size_t)conf.get_memory_mb() << 20) / 8);
+    }
+    size_t across = conf.is_horizontal() ? conf.get_height() : conf.get_width();
+    size_t len = cap / (std::max<size_t>(across, 1) * 3);
+    return (int)std::min<size_t>(std::max<size_t>(len, get_band_length(conf)), INT_MAX);
+}
+
+int get_max_append_length(const vector<int> &lengths, ptv::Config &conf) {
+    int threshold = get_band_threshold(conf);
+    int max_len = 0;
+    for (int len : lengths) {
+        max_len = std::max(max_len, conf.get_is_pdf() && len > threshold ? get_band_length(conf) : len);
+    }
+    return max_len;
+}
+
+// Renders [offset, offset + len) of a page along the scroll axis, at full
+// breadth, as a 3 channel BGR or gray image. Only the band is rasterized, so memory
+// follows the band, not the page.
+cv::Mat render_pdf_band(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf, int offset, int len) {
+    poppler::rectf rect = get_page_rect(page);
+    int across = get_rendered_length(conf.is_horizontal() ? rect.height() : rect.width(), dpi);
+    poppler::image img;
+    {
+        ptv::ScopedTimer timer("render");
+        if (conf.is_horizontal()) {
+            img = renderer.render_page(page, dpi, dpi, offset, 0, len, across);
+        } else {
+            img = renderer.render_page(page, dpi, dpi, 0, offset, across, len);
+        }
+    }
+    if (img.const_data() == nullptr || img.format() == poppler::image::format_invalid) {
+        return cv::Mat();
+    }
+    ptv::ScopedTimer timer("convert");
+    cv::Mat mat(img.height(), img.width(), get_page_type(img));
+    if (!convert_page_image(img, mat)) {
+        return cv::Mat();
+    }
+    timer.add_bytes(mat.total() * mat.elemSize());
+    return mat;
+}
+
+// poppler documents are not safe to share between threads,
+// so each render thread opens its own copy of every pdf it touches.
+// pool threads outlive a job in batch mode, so only the last few stay open.
+poppler::document *get_thread_document(const string &path) {
+    thread_local std::map<string, std::unique_ptr<poppler::document>> documents;
+    auto it = documents.find(path);
+    if (it == documents.end()) {
+        if (documents.size() >= MAX_THREAD_DOCUMENTS) {
+            documents.clear();
+        }
+        it = documents.emplace(path, poppler::document::load_from_file(path)).first;
+    }
+    return it->second.get();
+}
+
+// "Page 3", after the file name when there are several pdfs
+string get_pdf_page_title(const string &path, int pg, ptv::Config &conf) {
+    string title = "Page " + std::to_string(pg + 1);
+    if (conf.get_pdf_paths().size() > 1) {
+        title = fs::path(path).stem().string() + " - " + title;
+    }
+    return title;
+}
+
+// renders pages of every pdf on the thread pool and queues them in page order.
+// pages found in the cache are read back instead of rendered.
+// with --incremental each page is keyed by the hash of its frame, poppler
+// has no way to tell whether a page changed without rendering it.
+// only pages in `range` are rendered, queued from 0.
+// when scrolling, oversized pages are queued as bands (see render_pdf_band())
+// so they are rendered in parallel and only as the viewport gets near.
+void load_pdf_images(ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache, ptv::BoundedQueue<ptv::Page> &pages, PageRange range) {
+    size_t n = 0;
+    size_t index = 0; // queue position
+    ptv::WaitGroup rendering;
+    int band = get_band_length(conf);
+    int threshold = get_band_threshold(conf);
+
+    for (const string &path : conf.get_pdf_paths()) {
+        poppler::document *pdf = get_thread_document(path);
+        if (pdf == nullptr) {
+            std::cerr << "<!> Error: '" << path << "' could not be loaded. Skipped." << std::endl;
+            continue;
+        }
+        if (n + pdf->pages() <= range.first) {
+            n += pdf->pages();
+            continue;
+        }
+        uint64_t doc_hash = cache != nullptr ? ptv::PageCache::hash_file(path) : 0;
+
+        // Gets pages of individual pdf files
+        for (int pg = 0; pg < pdf->pages(); pg++) {
+            if (n >= range.last) {
+                rendering.wait();
+                return;
+            }
+            if (n++ < range.first) {
+                continue;
+            }
+            string title = get_pdf_page_title(path, pg, conf);
+
+            if (conf.get_style() != FRAMES) {
+                poppler::page *page = pdf->create_page(pg);
+                float dpi = get_page_dpi(page, conf);
+                poppler::rectf rect = get_page_rect(page);
+                int len = get_rendered_length(conf.is_horizontal() ? rect.width() : rect.height(), dpi);
+                delete page;
+                if (len > threshold) {
+                    for (int offset = 0; offset < len; offset += band, index++) {
+                        // queue was closed by the video generator
+                        if (!pages.reserve(index)) {
+                            rendering.wait();
+                            return;
+                        }
+                        int part = std::min(band, len - offset);
+                        rendering.add();
+                        pool.submit([&conf, &pages, &rendering, path, title, pg, index, dpi, offset, part, last = offset + part >= len] {
+                            poppler::page_renderer renderer;
+                            poppler::page *page = get_thread_document(path)->create_page(pg);
+                            cv::Mat mat;
+                            try {
+                                mat = render_pdf_band(page, renderer, dpi, conf, offset, part);
+                            } catch (cv::Exception &e) {
+                                std::cerr << "<!> Exception: " << e.msg << "\nLine: " << e.line << std::endl;
+                            }
+                            delete page;
+                            if (mat.empty()) {
+                                // black keeps the rest of the page where it belongs
+                                std::cerr << "<!> Error: Part of page " << pg << " of '" << path << "' could not be rendered." << std::endl;
+                                mat = conf.is_horizontal() ? cv::Mat(conf.get_height(), part, CV_8UC1, cv::Scalar(0))
+                                                           : cv::Mat(part, conf.get_width(), CV_8UC1, cv::Scalar(0));
+                            }
+                            pages.put(index, ptv::Page{index, mat, 0, !last, title});
+                            rendering.done();
+                        });
+                    }
+                    continue;
+                }
+            }
+
+            // queue was closed by the video generator
+            if (!pages.reserve(index)) {
+                rendering.wait();
+                return;
+            }
+            rendering.add();
+            pool.submit([&conf, &pages, &rendering, cache, doc_hash, path, title, pg, index] {
+                poppler::page_renderer renderer;
+                poppler::page *page = get_thread_document(path)->create_page(pg);
+                cv::Mat mat;
+                try {
+                    float dpi = get_page_dpi(page, conf);
+                    bool hit = false;
+                    if (cache != nullptr) {
+                        // whether the page is gray is only known once it is rendered
+                        ptv::ScopedTimer timer("cache");
+                        for (int type : {CV_8UC1, CV_8UC3}) {
+                            if (!hit) {
+                                hit = cache->load(ptv::PageCache::key(doc_hash, pg, dpi, type), mat, type);
+                            }
+                        }
+                        if (hit && conf.get_i420()) {
+                            cv::Mat cached = mat; // keeps the page alive while mat becomes the frame
+                            letterbox_to_i420(cached, cached.size(), mat, conf.get_width(), conf.get_height());
+                        } else if (hit && conf.get_style() == FRAMES && conf.get_letterbox()) {
+                            mat = letterbox_page(mat, conf);
+                        }
+                    }
+                    if (!hit && cache == nullptr && conf.get_i420()) {
+                        mat = render_pdf_i420(page, renderer, dpi, conf);
+                    } else if (!hit) {
+                        // the cache keeps pages, not frames
+                        cv::Mat view;
+                        mat = render_pdf_page(page, renderer, dpi, conf, view);
+                        if (cache != nullptr && !mat.empty()) {
+                            cache->store(ptv::PageCache::key(doc_hash, pg, dpi, view.type()), view);
+                        }
+                        if (conf.get_i420() && !mat.empty()) {
+                            letterbox_to_i420(view, view.size(), mat, conf.get_width(), conf.get_height());
+                        }
+                    }
+                } catch (cv::Exception &e) {
+                    std::cerr << "<!> Exception: " << e.msg << "\nLine: " << e.line << std::endl;
+                }
+                delete page;
+
+                if (mat.empty()) {
+                    std::cerr << "<!> Error: Page " << pg << " of '" << path << "' could not be rendered. Skipped." << std::endl;
+                    pages.skip(index);
+                } else {
+                    uint64_t key = conf.get_incremental() ? ptv::hash_frame(mat) : 0;
+                    pages.put(index, ptv::Page{index, mat, key, false, title});
+                }
+                rendering.done();
+            });
+            index++;
+        }
+    }
+    rendering.wait();
+}
+
+// How many pages the loaders may run ahead of the video generator. Wide
+// enough to keep every render thread busy, narrowed to fit --memory. Page
+// sizes are known before anything is rendered: whole frames in slideshows,
+// the longest page times the viewport's breadth when scrolling, plus what
+// the generator holds itself (a frame, or the compositor's strip).
+size_t get_queue_depth(ptv::Config &conf, const vector<int> &lengths, size_t threads) {
+    size_t depth = std::max<size_t>(DEFAULT_QUEUE_DEPTH, 2 * threads);
+    if (conf.get_memory_mb() <= 0) {
+        return depth;
+    }
+    size_t frame = (size_t)conf.get_width() * conf.get_height() * 3;
+    size_t page = conf.get_i420() ? frame / 2 : frame;
+    size_t fixed = frame + page; // frame being encoded and the page it came from
+    if (conf.get_style() != FRAMES && !lengths.empty()) {
+        size_t along = conf.is_horizontal() ? conf.get_width() : conf.get_height();
+        size_t across = conf.is_horizontal() ? conf.get_height() : conf.get_width();
+        size_t max_len = (size_t)get_max_append_length(lengths, conf);
+        page = max_len * across * 3;
+        fixed = (2 * along + std::max(max_len, along)) * across * 3 + page; // strip, see ScrollCompositor
+    }
+    size_t budget = (size_t)conf.get_memory_mb() << 20;
+    size_t fit = budget > fixed ? (budget - fixed) / std::max<size_t>(page, 1) : 0;
+    if (fit < 1) {
+        std::cerr << "<!> Warning: --memory " << conf.get_memory_mb() << " is less than the video needs ("
+                  << ((fixed + page) >> 20) + 1 << "MB), loading one page at a time." << std::endl;
+    }
+    fit = std::min(std::max<size_t>(fit, 1), depth);
+    if (conf.get_verbose() && fit < depth) {
+        std::cout << "Loading " << fit << " pages ahead to stay within " << conf.get_memory_mb() << "MB." << std::endl;
+    }
+    return fit;
+}
+
+// pops the next page, time spent blocked on the loaders is the "wait" stage
+bool next_page(ptv::BoundedQueue<ptv::Page> &pages, ptv::Page &page) {
+    ptv::ScopedTimer timer("wait");
+    return pages.pop(page);
+}
+
+// pixels scrolled per frame
+float get_px_per_frame(const vector<int> &lengths, ptv::Config &conf) {
+    int length_of_imgs = 0;
+    for (size_t i = 0; i < lengths.size(); i++) {
+        length_of_imgs += lengths[i];
+    }
+    float px_per_frame = 0.0f;
+    if (conf.get_duration() == 0) {
+        px_per_frame += length_of_imgs / (conf.get_fps() * conf.get_spp() * lengths.size());
+    } else {
+        px_per_frame = length_of_imgs / (conf.get_fps() * conf.get_duration());
+    }
+    return px_per_frame;
+}
+
+// frames scroll_video() writes: from the black viewport through every page
+// and out to black, stopping where ScrollCompositor::next_frame() does
+int64_t get_scroll_frames(const vector<int> &lengths, float px_per_frame, ptv::Config &conf) {
+    int along = conf.is_horizontal() ? conf.get_width() : conf.get_height();
+    int64_t total = along + along + (int64_t)std::ceil(px_per_frame);
+    for (int len : lengths) {
+        total += len;
+    }
+    auto fits = [&](int64_t n) { return (double)total - ((double)n * px_per_frame + along) > px_per_frame; };
+    int64_t frames = std::max<int64_t>(0, (int64_t)((total - along) / px_per_frame) - 1);
+    while (frames > 0 && !fits(frames - 1)) {
+        frames--;
+    }
+    while (fits(frames)) {
+        frames++;
+    }
+    return frames;
+}
+
+// Cuts the video into --segments parts of about the same length: page
+// ranges for slideshows, frame ranges for scrolling. A scroll segment
+// starts loading at the last page that reaches into its first frame.
+vector<Segment> get_segments(const vector<int> &lengths, size_t page_count, ptv::Config &conf) {
+    vector<Segment> segs;
+    int64_t n = conf.get_segments();
+    if (conf.get_style() == FRAMES) {
+        n = std::min<int64_t>(n, page_count);
+        for (int64_t k = 0; k < n; k++) {
+            Segment seg;
+            seg.first_page = page_count * k / n;
+            seg.last_page = page_count * (k + 1) / n;
+            segs.push_back(seg);
+        }
+        return segs;
+    }
+
+    float px_per_frame = lengths.empty() ? 0.0f : get_px_per_frame(lengths, conf);
+    if (px_per_frame <= 0.0f) {
+        return {Segment()};
+    }
+    int64_t frames = get_scroll_frames(lengths, px_per_frame, conf);
+    n = std::max<int64_t>(1, std::min<int64_t>(n, frames));
+    int along = conf.is_horizontal() ? conf.get_width() : conf.get_height();
+    size_t page = 0;
+    int64_t start = along; // logical position of `page`
+    for (int64_t k = 0; k < n; k++) {
+        Segment seg;
+        seg.first_frame = frames * k / n;
+        seg.frames = k + 1 < n ? frames * (k + 1) / n - seg.first_frame : -1;
+        int64_t top = (int64_t)std::floor((double)seg.first_frame * px_per_frame);
+        while (page + 1 < lengths.size() && start + lengths[page] <= top) {
+            start += lengths[page];
+            page++;
+        }
+        if (top >= start) {
+            seg.first_page = page;
+            seg.origin = start;
+        }
+        segs.push_back(seg);
+    }
+    return segs;
+}
+
+// scroll effect, one instance per direction
+template <ptv::Axis A, bool Reverse>
+void scroll_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, const vector<int> &lengths, ptv::Config &conf, const Segment &seg) {
+    if (lengths.empty()) {
+        std::cerr << "<!> Error: No pages to render." << std::endl;
+        return;
+    }
+
+    // Find px_per_frame, reported once
+    bool whole = seg.first_frame == 0;
+    float px_per_frame = get_px_per_frame(lengths, conf);
+    if (px_per_frame <= 0.0f) {
+        px_per_frame = 1.0f;
+        if (whole) {
+            std::cerr << "<!> Warning: pixels per frame value was <= 0.0, set value to 1.0" << std::endl;
+        }
+    }
+    if (conf.get_verbose() && whole) {
+        std::cout << "Pixels per frame: " << px_per_frame << std::endl;
+    }
+
+    // Frames are views into the compositor's strip, nothing is copied per frame
+    // unless --smooth has to blend a frame between two pixel offsets.
+    // The strip stays gray until a page with color comes in.
+    int max_len = get_max_append_length(lengths, conf);
+    ptv::ScrollCompositor<A, Reverse> strip(conf.get_width(), conf.get_height(), max_len, px_per_frame, conf.get_smooth(), CV_8UC1);
+    strip.seek(seg.first_frame, seg.origin);
+    if (seg.origin == 0) {
+        strip.append_blank(strip.viewport());
+    }
+    // A page starts at the frame where its leading edge reaches the far
+    // side of the viewport, the page then fills it. Pages that started in
+    // an earlier segment are not marked again.
+    std::deque<std::pair<int64_t, string>> starts; // frame, title
+    int64_t pos = seg.origin == 0 ? strip.viewport() : seg.origin; // logical position of the next piece
+    bool page_start = true; // the next piece is not a band continuing a page
+
+    cv::Mat frame;
+    int64_t written = 0;
+    auto write_frames = [&] {
+        while ((seg.frames < 0 || written < seg.frames) && strip.next_frame(frame)) {
+            int64_t n = seg.first_frame + written;
+            while (!starts.empty() && starts.front().first <= n) {
+                if (starts.front().first >= seg.first_frame) {
+                    vid.mark_page(starts.front().second);
+                }
+                starts.pop_front();
+            }
+            ptv::ScopedTimer timer("encode");
+            vid.write(frame);
+            written++;
+        }
+        return seg.frames >= 0 && written >= seg.frames;
+    };
+
+    size_t count = seg.first_page;
+    ptv::Page page;
+    while (next_page(pages, page)) {
+        if (page_start) {
+            starts.emplace_back((int64_t)std::ceil((double)pos / px_per_frame), page.title);
+        }
+        pos += A == ptv::Axis::Horizontal ? page.img.cols : page.img.rows;
+        page_start = !page.partial;
+        strip.append(page.img);
+        page.img.release();
+
+        // Generates and writes frames to video file
+        bool done = write_frames();
+        vid.flush();
+
+        // Finished Rendering Current Image
+        count += page.partial ? 0 : 1;
+        if (conf.get_verbose() && conf.get_segments() == 1 && !page.partial) {
+            std::cout << count << "/" << lengths.size() << std::endl;
+        }
+        if (done) {
+            // later pages belong to the next segment
+            pages.close();
+            return;
+        }
+    }
+
+    // allows video to scroll to black at end
+    strip.append_blank(strip.viewport() + (int)std::ceil(px_per_frame));
+    write_frames();
+}
+
+void generate_scroll_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, const vector<int> &lengths, ptv::Config &conf, const Segment &seg) {
+    if (conf.get_style() == UP) {
+        scroll_video<ptv::Axis::Vertical, false>(vid, pages, lengths, conf, seg);
+    } else if (conf.get_style() == DOWN) {
+        scroll_video<ptv::Axis::Vertical, true>(vid, pages, lengths, conf, seg);
+    } else if (conf.get_style() == LEFT) {
+        scroll_video<ptv::Axis::Horizontal, false>(vid, pages, lengths, conf, seg);
+    } else if (conf.get_style() == RIGHT) {
+        scroll_video<ptv::Axis::Horizontal, true>(vid, pages, lengths, conf, seg);
+    }
+}
+
+// classic image sequence effect
+void generate_sequence_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, ptv::Config &conf) {
+    // with -s each page is written once and held, the encoder decides
+    // whether that means repeating the frame or one longer frame
+    int64_t frames_per_page = 1;
+    if (conf.has_spp()) {
+        frames_per_page = std::max<int64_t>(1, std::lround(conf.get_fps() * conf.get_spp()));
+    }
+    ptv::Page page;
+    while (next_page(pages, page)) {
+        vid.mark_page(page.title);
+        if (conf.get_incremental() && vid.begin_page(page.key)) {
+            // copied from the previous render
+            vid.hold(frames_per_page - 1);
+            continue;
+        }
+        if (page.img.empty()) {
+            continue;
+        }
+        if (conf.get_i420()) {
+            // loaders built the whole frame already
+            ptv::ScopedTimer encode("encode");
+            vid.write_i420(page.img);
+            vid.hold(frames_per_page - 1);
+            vid.flush();
+            continue;
+        }
+
+        ptv::ScopedTimer compose("compose");
+        cv::Mat vp_img = page.img;
+
+        // loaders already hand over letterboxed frames, other pages
+        // are centered without stretching, keeping them within the vp.
+        if (vp_img.rows != conf.get_height() || vp_img.cols != conf.get_width()) {
+            vp_img = letterbox_page(page.img, conf);
+            compose.add_bytes(vp_img.total() * vp_img.elemSize());
+        }
+
+        ptv::ScopedTimer encode("encode");
+        vid.write(vp_img);
+        vid.hold(frames_per_page - 1);
+        vid.flush();
+    }
+}
+
+// --segments: every segment has its own loader, generator and encoder, all
+// running at the same time on the shared render pool. Each segment is
+// encoded into a file next to the output, then the files are joined.
+void generate_segments(const ptv::SeqIndex &seq, const vector<int> &lengths, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache) {
+    vector<Segment> segs = get_segments(lengths, get_page_count(seq, conf), conf);
+    size_t depth = std::max<size_t>(1, get_queue_depth(conf, lengths, pool.size()) / segs.size());
+    vector<string> paths;
+    for (size_t k = 0; k < segs.size(); k++) {
+        paths.push_back(conf.get_output() + ".seg" + std::to_string(k) + conf.get_format());
+    }
+    if (conf.get_verbose()) {
+        std::cout << "Encoding " << segs.size() << " segments..." << std::endl;
+    }
+
+    vector<string> errors(segs.size());
+    vector<std::thread> workers;
+    for (size_t k = 0; k < segs.size(); k++) {
+        workers.emplace_back([&, k] {
+            try {
+                const Segment &seg = segs[k];
+                std::unique_ptr<ptv::Encoder> video = ptv::open_segment_encoder(conf, paths[k]);
+                if (video == nullptr) {
+                    throw std::runtime_error("<!> Error: Could not open '" + paths[k] + "' for writing.");
+                }
+                ptv::BoundedQueue<ptv::Page> pages(depth);
+                PageRange range{seg.first_page, seg.last_page};
+                string load_error = "";
+                std::thread loader([&] {
+                    try {
+                        if (conf.get_is_pdf()) {
+                            load_pdf_images(conf, pool, cache, pages, range);
+                        } else if (conf.get_is_seq()) {
+                            load_seq_images(seq, conf, pool, pages, nullptr, range);
+                        }
+                    } catch (const std::exception &e) {
+                        load_error = e.what();
+                    }
+                    pages.close();
+                });
+                try {
+                    if (conf.get_style() == FRAMES) {
+                        generate_sequence_video(*video, pages, conf);
+                    } else {
+                        generate_scroll_video(*video, pages, lengths, conf, seg);
+                    }
+                } catch (...) {
+                    pages.close();
+                    loader.join();
+                    throw;
+                }
+                pages.close();
+                loader.join();
+                video->release();
+                if (load_error != "") {
+                    throw std::runtime_error(load_error);
+                }
+            } catch (const std::exception &e) {
+                errors[k] = e.what();
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    string error = "";
+    for (const string &e : errors) {
+        if (error == "" && e != "") {
+            error = e;
+        }
+    }
+    if (error == "" && !ptv::concat_segments(conf, paths)) {
+        error = "<!> Error: Could not join the segments into '" + conf.get_output() + "'.";
+    }
+    for (const string &path : paths) {
+        std::error_code err;
+        fs::remove(path, err);
+    }
+    if (error != "") {
+        throw std::runtime_error(error);
+    }
+}
+
+// A page loaded once for every rendition, made into what the loaders
+// would have handed rendition `conf`: a letterboxed frame (I420 if the
+// encoder takes it) in slideshows, the page scaled across the viewport
+// when scrolling.
+ptv::Page adapt_page(const ptv::Page &src, ptv::Config &conf) {
+    ptv::Page page{src.index, cv::Mat(), src.key, src.partial, src.title};
+    if (src.img.empty()) {
+        return page;
+    }
+    ptv::ScopedTimer timer("scale");
+    cv::Size size = get_scaled_size(src.img.size(), conf);
+    if (conf.get_style() == FRAMES && conf.get_i420()) {
+        // the fused pass is bilinear, below half size it would alias where
+        // the BGR path (OpenCV's writer) does not: reduce with INTER_AREA first
+        if (size.width * 2 <= src.img.cols && size.height * 2 <= src.img.rows) {
+            cv::Mat reduced;
+            cv::resize(src.img, reduced, size, 0, 0, cv::INTER_AREA);
+            letterbox_to_i420(reduced, size, page.img, conf.get_width(), conf.get_height());
+        } else {
+            letterbox_to_i420(src.img, size, page.img, conf.get_width(), conf.get_height());
+        }
+    } else if (conf.get_style() == FRAMES) {
+        page.img = cv::Mat(conf.get_height(), conf.get_width(), src.img.type());
+        cv::Rect2i roi = get_letterbox_roi(size, page.img.size());
+        fill_letterbox(page.img, roi);
+        cv::Mat dst = page.img(roi);
+        cv::resize(src.img, dst, roi.size(), 0, 0, cv::INTER_AREA);
+    } else if (size == src.img.size()) {
+        page.img = src.img;
+    } else {
+        cv::resize(src.img, page.img, size, 0, 0, cv::INTER_AREA);
+    }
+    timer.add_bytes(page.img.total() * page.img.elemSize());
+    return page;
+}
+
+// Several -r resolutions in one run. Pages are loaded once, at the dpi
+// the largest rendition needs, then every rendition scales them on the
+// render pool and has its own generator and encoder thread.
+void generate_renditions(const ptv::SeqIndex &seq, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache) {
+    vector<cv::Size> sizes = conf.get_renditions();
+
+    // the loaders fit pages in a box covering every rendition
+    ptv::Config source = conf;
+    int width = 0;
+    int height = 0;
+    for (const cv::Size &size : sizes) {
+        width = std::max(width, size.width);
+        height = std::max(height, size.height);
+    }
+    source.set_width(width);
+    source.set_height(height);
+    source.set_letterbox(false);
+    source.set_i420(false);
+    vector<int> source_lengths = {};
+    if (conf.get_style() != FRAMES) {
+        source_lengths = conf.get_is_pdf() ? get_pdf_page_lengths(source) : get_seq_image_lengths(seq, source);
+    }
+
+    vector<ptv::Config> confs(sizes.size(), conf);
+    vector<vector<int>> lengths(sizes.size());
+    vector<std::unique_ptr<ptv::Encoder>> videos;
+    vector<std::unique_ptr<ptv::BoundedQueue<ptv::Page>>> queues;
+    for (size_t r = 0; r < sizes.size(); r++) {
+        confs[r].set_width(sizes[r].width);
+        confs[r].set_height(sizes[r].height);
+        confs[r].set_output(conf.get_rendition_output(sizes[r]));
+        if (conf.get_style() != FRAMES) {
+            lengths[r] = conf.get_is_pdf() ? get_pdf_page_lengths(confs[r]) : get_seq_image_lengths(seq, confs[r]);
+        }
+        videos.push_back(ptv::open_encoder(confs[r]));
+        if (!videos[r]->is_opened()) {
+            throw std::runtime_error("<!> Error: Could not open '" + confs[r].get_output() + "' for writing.");
+        }
+        confs[r].set_i420(conf.get_style() == FRAMES && videos[r]->prefers_i420());
+        queues.push_back(std::make_unique<ptv::BoundedQueue<ptv::Page>>(DEFAULT_QUEUE_DEPTH));
+    }
+
+    ptv::BoundedQueue<ptv::Page> pages(get_queue_depth(source, source_lengths, pool.size()));
+    string load_error = "";
+    std::thread loader([&] {
+        try {
+            if (conf.get_is_pdf()) {
+                load_pdf_images(source, pool, cache, pages);
+            } else if (conf.get_is_seq()) {
+                load_seq_images(seq, source, pool, pages);
+            }
+        } catch (const std::exception &e) {
+            load_error = e.what();
+        }
+        pages.close();
+    });
+
+    if (conf.get_verbose()) {
+        std::cout << "Generating " << sizes.size() << " Videos..." << std::endl;
+    }
+    vector<string> errors(sizes.size());
+    vector<std::thread> workers;
+    for (size_t r = 0; r < sizes.size(); r++) {
+        workers.emplace_back([&, r] {
+            try {
+                if (conf.get_style() == FRAMES) {
+                    generate_sequence_video(*videos[r], *queues[r], confs[r]);
+                } else {
+                    generate_scroll_video(*videos[r], *queues[r], lengths[r], confs[r]);
+                }
+            } catch (const std::exception &e) {
+                errors[r] = e.what();
+            }
+            queues[r]->close();
+        });
+    }
+
+    // hands every page to every rendition, scaled on the render pool
+    ptv::WaitGroup scaling;
+    size_t index = 0;
+    ptv::Page page;
+    while (next_page(pages, page)) {
+        for (size_t r = 0; r < sizes.size(); r++) {
+            if (!queues[r]->reserve(index)) {
+                continue;
+            }
+            scaling.add();
+            pool.submit([&, r, index, src = page] {
+                queues[r]->put(index, adapt_page(src, confs[r]));
+                scaling.done();
+            });
+        }
+        index++;
+    }
+    scaling.wait();
+    for (auto &queue : queues) {
+        queue->close();
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    pages.close();
+    loader.join();
+    for (auto &video : videos) {
+        video->release();
+    }
+
+    for (const string &error : errors) {
+        if (error != "") {
+            throw std::runtime_error(error);
+        }
+    }
+    if (load_error != "") {
+        throw std::runtime_error(load_error);
+    }
+}
+
+// the whole video through one encoder
+void generate_video(const ptv::SeqIndex &seq, const vector<int> &lengths, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache) {
+    if (conf.get_verbose()) {
+        std::cout << "Initializing Video Renderer..." << std::endl;
+    }
+    std::unique_ptr<ptv::Encoder> video = ptv::open_encoder(conf);
+    if (!video->is_opened()) {
+        throw std::runtime_error("<!> Error: Could not open '" + conf.get_output() + "' for writing.");
+    }
+    conf.set_i420(conf.get_style() == FRAMES && video->prefers_i420());
+
+    // Loader thread produces pages, this thread encodes them as they arrive.
+    ptv::BoundedQueue<ptv::Page> pages(get_queue_depth(conf, lengths, pool.size()));
+    string load_error = "";
+    std::thread loader([&] {
+        try {
+            if (conf.get_is_pdf()) {
+                load_pdf_images(conf, pool, cache, pages);
+            } else if (conf.get_is_seq()) {
+                load_seq_images(seq, conf, pool, pages, video.get());
+            }
+        } catch (const std::exception &e) {
+            load_error = e.what();
+        }
+        pages.close();
+    });
+
+    if (conf.get_verbose()) {
+        std::cout << "Generating Video..." << std::endl;
+    }
+    try {
+        if (conf.get_style() == FRAMES) {
+            generate_sequence_video(*video, pages, conf);
+        } else {
+            generate_scroll_video(*video, pages, lengths, conf);
+        }
+    } catch (...) {
+        pages.close();
+        loader.join();
+        throw;
+    }
+
+    // Clean Up
+    pages.close();
+    loader.join();
+    video->release();
+    if (load_error != "") {
+        throw std::runtime_error(load_error);
+    }
+}
+
+// Buffers worth pooling for a job (see PoolAllocator): gray, I420 and BGR
+// frames of every resolution, and the scroll strip in both types.
+vector<size_t> get_pooled_sizes(const vector<int> &lengths, ptv::Config &conf) {
+    vector<cv::Size> sizes = conf.get_renditions();
+    if (sizes.empty()) {
+        sizes.push_back(cv::Size(conf.get_width(), conf.get_height()));
+    }
+    sizes[0] = cv::Size(conf.get_width(), conf.get_height());
+    vector<size_t> bytes;
+    for (const cv::Size &size : sizes) {
+        size_t frame = (size_t)size.width * size.height;
+        if (frame > 0) {
+            bytes.insert(bytes.end(), {frame, frame * 3 / 2, frame * 3});
+        }
+    }
+    if (conf.get_style() != FRAMES && !lengths.empty()) {
+        // same length as ScrollCompositor's
+        float px_per_frame = std::max(get_px_per_frame(lengths, conf), 1.0f);
+        size_t along = conf.is_horizontal() ? conf.get_width() : conf.get_height();
+        size_t across = conf.is_horizontal() ? conf.get_height() : conf.get_width();
+        size_t tail = along + (size_t)std::ceil(px_per_frame) + 1;
+        size_t strip = (2 * tail + std::max<size_t>(get_max_append_length(lengths, conf), tail)) * across;
+        bytes.insert(bytes.end(), {strip, strip * 3});
+    }
+    return bytes;
+}
+
+// one conversion, start to finish. errors are returned instead of exiting,
+// so batch mode can keep going. `cache` may be null.
+JobResult run_job(ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache) {
+    JobResult result;
+    auto start_time = std::chrono::steady_clock::now();
+    try {
+        if (conf.get_stream() && !ptv::stream_supported()) {
+            throw std::runtime_error("<!> Error: --stream needs ptv built with libav.");
+        }
+        if (conf.get_output() == "-" && conf.get_renditions().size() > 1) {
+            throw std::runtime_error("<!> Error: Several resolutions cannot be written to stdout.");
+        }
+        // Resolution and page geometry are known before anything is rasterized,
+        // so the video writer can start while pages are still loading.
+        if (conf.get_verbose()) {
+            std::cout << "Loading Images..." << std::endl;
+        }
+        ptv::SeqIndex seq;
+        vector<int> lengths = {};
+        if (conf.get_is_pdf()) {
+            set_pdf_resolution(conf);
+            if (conf.get_style() != FRAMES) {
+                lengths = get_pdf_page_lengths(conf);
+            }
+        } else if (conf.get_is_seq()) {
+            seq = ptv::SeqIndex::build(conf.get_seq_dirs(), pool, conf.get_cache_dir());
+            if (seq.empty()) {
+                throw std::runtime_error("<!> Error: No numbered images found in the sequence directories.");
+            }
+            if (seq.gaps > 0) {
+                std::cerr << "<!> Warning: " << seq.gaps << " images missing from the sequence numbering." << std::endl;
+            }
+            set_seq_resolution(seq, conf);
+            if (conf.get_style() != FRAMES) {
+                lengths = get_seq_image_lengths(seq, conf);
+            }
+        }
+
+        ptv::PooledSizes pooled(get_pooled_sizes(lengths, conf));
+
+        std::unique_ptr<ptv::PageCache> own_cache;
+        if (cache == nullptr && conf.get_is_pdf() && conf.get_cache_dir() != "") {
+            own_cache = std::make_unique<ptv::PageCache>(conf.get_cache_dir(), (uintmax_t)conf.get_cache_mb() << 20);
+            cache = own_cache.get();
+        }
+
+        bool segmented = conf.get_segments() > 1;
+        if (segmented && conf.get_renditions().size() > 1) {
+            std::cerr << "<!> Warning: --segments is ignored with several resolutions." << std::endl;
+            segmented = false;
+        } else if (segmented && conf.get_stream()) {
+            std::cerr << "<!> Warning: --segments is ignored with --stream." << std::endl;
+            segmented = false;
+        } else if (segmented && conf.get_incremental()) {
+            std::cerr << "<!> Warning: --segments is ignored with --incremental." << std::endl;
+            segmented = false;
+        } else if (segmented && !ptv::segments_supported()) {
+            std::cerr << "<!> Warning: --segments needs ptv built with libav, encoding in one piece." << std::endl;
+            segmented = false;
+        }
+        if (conf.get_renditions().size() > 1) {
+            generate_renditions(seq, conf, pool, cache);
+        } else if (segmented) {
+            // segments are encoded by the libav encoder, which takes I420
+            conf.set_i420(conf.get_style() == FRAMES);
+            generate_segments(seq, lengths, conf, pool, cache);
+        } else {
+            generate_video(seq, lengths, conf, pool, cache);
+        }
+        result.ok = true;
+    } catch (const std::exception &e) {
+        result.error = e.what();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return result;
+}
@@ -0,0 +1,104 @@
+#ifndef PTV_PIPELINE_HPP
+#define PTV_PIPELINE_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "opencv.hpp"
+#include "poppler.hpp"
+#include "ptv.hpp"
+#include "cache.hpp"
+#include "encoder.hpp"
+#include "pool.hpp"
+#include "queue.hpp"
+#include "seqindex.hpp"
+
+using std::string;
+using std::vector;
+
+#define MAX_THREAD_DOCUMENTS 8 // pdfs each render thread keeps open
+#define SCROLL_BAND_MAX_MB 64 // when scrolling, pdf pages bigger than this (or than 1/8 of --memory) are rendered in bands
+#define SCROLL_BAND_VIEWPORTS 2 // length of those bands
+
+// outcome of one conversion
+struct JobResult {
+    bool ok = false;
+    string error = "";
+    double seconds = 0;
+};
+
+// pages [first, last) of the input, in loading order
+struct PageRange {
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+};
+
+// Part of the video composed and encoded on its own (--segments).
+// The whole video is one segment.
+struct Segment {
+    size_t first_page = 0;
+    size_t last_page = SIZE_MAX; // slideshows
+    int64_t first_frame = 0;     // scroll
+    int64_t frames = -1;         // scroll, -1 = until the pages run out
+    int64_t origin = 0;          // scroll, logical position of first_page, 0 = the black viewport before page 0
+};
+
+// Stages of the pdf/image sequence to video pipeline, shared by ptv and ptv-bench.
+
+void scale_image_to_width(cv::Mat &img, int dst_width);
+void scale_image_to_height(cv::Mat &img, int dst_height);
+void scale_image_to_scroll(cv::Mat &img, ptv::Config &conf); // fits image across the scroll axis
+void scale_image_to_fit(cv::Mat& img, ptv::Config &conf);
+float get_fit_scale(int cols, int rows, ptv::Config &conf); // scale used by scale_image_to_fit()
+cv::Size get_scaled_size(cv::Size size, ptv::Config &conf); // size after scale_image_to_fit() or scale_image_to_scroll()
+
+poppler::rectf get_page_rect(poppler::page *page); // crop box in points, rotated as rendered
+int get_rendered_length(double points, float dpi); // pixels poppler renders for `points` at `dpi`
+float get_scaled_dpi_from_width(poppler::page *page, int width); // dpi fits page to vp width
+float get_scaled_dpi_from_height(poppler::page *page, int height); // dpi fits page to vp height
+float get_scaled_dpi_to_scroll(poppler::page *page, ptv::Config &conf); // dpi fits page across the scroll axis
+float get_scaled_dpi_to_fit(poppler::page *page, ptv::Config &conf); // dpi fits page in viewport
+float get_page_dpi(poppler::page *page, ptv::Config &conf); // dpi a page is rendered at
+
+void set_seq_resolution(const ptv::SeqIndex &seq, ptv::Config &conf);
+void set_pdf_resolution(ptv::Config &conf);
+
+vector<int> get_seq_image_lengths(const ptv::SeqIndex &seq, ptv::Config &conf); // lengths along the scroll axis
+vector<int> get_pdf_page_lengths(ptv::Config &conf); // lengths along the scroll axis
+size_t get_page_count(const ptv::SeqIndex &seq, ptv::Config &conf);
+
+cv::Mat read_seq_image(const ptv::SeqImage &img, ptv::Config &conf);
+void load_seq_images(const ptv::SeqIndex &seq, ptv::Config &conf, ptv::ThreadPool &pool, ptv::BoundedQueue<ptv::Page> &pages,
+                     const ptv::Encoder *reuse = nullptr, PageRange range = {});
+poppler::document *get_thread_document(const string &path); // per-thread copy of a pdf
+cv::Rect2i get_letterbox_roi(cv::Size page, cv::Size frame); // centers a page in the frame
+void fill_letterbox(cv::Mat &frame, const cv::Rect2i &roi); // blacks out the frame around roi
+cv::Mat letterbox_page(const cv::Mat &img, ptv::Config &conf);
+int get_page_type(const poppler::image &img); // CV_8UC1 for pages without color, see gray.hpp
+bool convert_page_image(const poppler::image &img, cv::Mat dst); // poppler buffer to BGR (or gray) in one pass
+string get_pdf_page_title(const string &path, int pg, ptv::Config &conf); // chapter name
+cv::Mat render_pdf_page(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf, cv::Mat &view);
+int get_band_length(ptv::Config &conf); // see SCROLL_BAND_VIEWPORTS
+int get_band_threshold(ptv::Config &conf); // pages longer than this are banded, see SCROLL_BAND_MAX_MB
+int get_max_append_length(const vector<int> &lengths, ptv::Config &conf); // longest piece of a page the compositor gets at once
+cv::Mat render_pdf_band(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf, int offset, int len);
+cv::Mat render_pdf_i420(poppler::page *page, poppler::page_renderer &renderer, float dpi, ptv::Config &conf); // whole slideshow frame, see yuv.hpp
+void load_pdf_images(ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache, ptv::BoundedQueue<ptv::Page> &pages, PageRange range = {});
+
+size_t get_queue_depth(ptv::Config &conf, const vector<int> &lengths, size_t threads); // pages loaders run ahead, see --memory
+bool next_page(ptv::BoundedQueue<ptv::Page> &pages, ptv::Page &page); // pop timed as a pipeline stall
+float get_px_per_frame(const vector<int> &lengths, ptv::Config &conf); // scroll speed from -s or -d
+int64_t get_scroll_frames(const vector<int> &lengths, float px_per_frame, ptv::Config &conf); // frames in a scroll video
+vector<size_t> get_pooled_sizes(const vector<int> &lengths, ptv::Config &conf); // frame and strip sizes, see alloc.hpp
+vector<Segment> get_segments(const vector<int> &lengths, size_t page_count, ptv::Config &conf); // --segments cuts
+void generate_scroll_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, const vector<int> &lengths, ptv::Config &conf, const Segment &seg = {});
+void generate_sequence_video(ptv::Encoder &vid, ptv::BoundedQueue<ptv::Page> &pages, ptv::Config &conf);
+ptv::Page adapt_page(const ptv::Page &src, ptv::Config &conf); // shared page to what rendition `conf` takes
+void generate_renditions(const ptv::SeqIndex &seq, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache);
+void generate_video(const ptv::SeqIndex &seq, const vector<int> &lengths, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache);
+void generate_segments(const ptv::SeqIndex &seq, const vector<int> &lengths, ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache);
+
+JobResult run_job(ptv::Config &conf, ptv::ThreadPool &pool, ptv::PageCache *cache); // whole conversion, never exits
+
+#endif
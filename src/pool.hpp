@@ -0,0 +1,100 @@
+#ifndef PTV_POOL_HPP
+#define PTV_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ptv {
+
+// Fixed set of worker threads running tasks in submission order (FIFO).
+class ThreadPool {
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                has_task_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    public:
+        ThreadPool(size_t threads) {
+            if (threads < 1) {
+                threads = 1;
+            }
+            for (size_t i = 0; i < threads; i++) {
+                workers_.emplace_back([this] { run(); });
+            }
+        }
+
+        // finishes queued tasks before joining
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            has_task_.notify_all();
+            for (auto &worker : workers_) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void submit(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push_back(std::move(task));
+            }
+            has_task_.notify_one();
+        }
+
+        size_t size() { return workers_.size(); }
+};
+
+// Counts outstanding tasks so a producer can wait for the ones it submitted.
+class WaitGroup {
+    size_t count_ = 0;
+    std::mutex mutex_;
+    std::condition_variable zero_;
+
+    public:
+        void add() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            count_++;
+        }
+
+        void done() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--count_ == 0) {
+                zero_.notify_all();
+            }
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            zero_.wait(lock, [this] { return count_ == 0; });
+        }
+};
+
+}
+#endif
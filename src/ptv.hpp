@@ -1,10 +1,14 @@
 #ifndef PTV_HPP
 #define PTV_HPP
 
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <filesystem>
+#include <thread>
 #include "opencv.hpp"
 #include "poppler-rectangle.h"
 
@@ -14,15 +18,35 @@ namespace ptv {
 ptv [options...]\n\
 Help Options: \n\
    -h, --help                             :  show this help text.\n\
+   -y, --yes                              :  do not ask to confirm the settings.\n\
+   --batch <manifest>                     :  runs many jobs in one process, see ptv --batch <manifest> --help\n\
 Application Options: \n\
    [pdf_paths...]                         :  PDF file path. /home/usr/example.pdf\n\
    [img_sequence_dirs...]                 :  image sequence directory. /home/usr/example_seq/\n\
    -r <int>x<int>                         :  set output resolution. Use 0 to preserve resolution of original content, default: 1280x720 \n\
+   -r <int>x<int>,<int>x<int>,...         :  several resolutions from one rendering, written to <output>_<width>x<height>.mp4\n\
    -f <float>                             :  frames per second.\n\
-   -s <float>                             :  seconds per frame.\n\
-   -d <float>                             :  duration in seconds. NOTE: overides -s (seconds per frame)\n\
+   -s <float>                             :  seconds per page. slideshows write one frame per page unless set\n\
+   -d <float>                             :  duration in seconds. NOTE: overides -s (seconds per page)\n\
    -o [output_path]                       :  currently only support .mp4 files, leave blank for auto output\n\
+   -o -                                   :  streams the video to stdout, see --stream\n\
    -a [Up|Down|Left|Right]                :  scrolls content instead of making each page a frame (like a slideshow).\n\
+   -j <int>                               :  number of threads used to render pages, default: number of cores\n\
+   --smooth                               :  sub-pixel scrolling, blends frames that fall between two pixels.\n\
+   --cache <dir>                          :  keeps rendered pdf pages (and image sequence indexes) in <dir> so reruns skip rendering.\n\
+   --cache-size <int>                     :  max size of the page cache in MB, default: 1024\n\
+   --memory <int>                         :  max MB of rendered pages held at once, default: no limit\n\
+   --incremental                          :  slideshows only: reuses unchanged pages from the last render of the same output.\n\
+   --stats                                :  prints time spent in each stage (render, scale, encode...) at the end.\n\
+   --trace <file>                         :  writes a Chrome trace (chrome://tracing) of every stage to <file>.\n\
+Encoder Options: \n\
+   -c [h264|h265|av1|mpeg4]               :  video codec, default: h264\n\
+   -q <int>                               :  constant rate factor (quality), lower is better. default: codec default\n\
+   -p <preset>                            :  encoder preset. ex: ultrafast, medium, slow (x264/x265) or 0-13 (av1)\n\
+   -t <int>                               :  encoder threads, default: 0 (auto)\n\
+   -g <int>                               :  max frames between keyframes, default: 10 seconds\n\
+   --segments <int>                       :  encodes the video as <int> parts at the same time, then joins them. default: 1\n\
+   --stream                               :  writes fragmented mp4, flushed after every page, readable while it is written (pipes).\n\
 "
 #define FRAMES "Frames"
 #define UP "Up"
@@ -30,167 +54,330 @@ Application Options: \n\
 #define LEFT "Left"
 #define RIGHT "Right"
 
+#define H264 "h264"
+#define H265 "h265"
+#define AV1 "av1"
+#define MPEG4 "mpeg4"
+
 #define DEFAULT_DPI 72.0f
+#define DEFAULT_QUEUE_DEPTH 4 // pages buffered between loader and video generator
+#define DEFAULT_CACHE_MB 1024
+#define DEFAULT_GOP_SECONDS 10 // keyframe distance without -g, pages start keyframes of their own
+
+// Invalid options or input paths.
+class ConfigError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+};
+
+// A loaded page (or image) on its way to the video generator.
+struct Page {
+    size_t index = 0;
+    cv::Mat img; // empty if the encoder reuses the page (--incremental)
+    uint64_t key = 0; // content hash, set with --incremental
+    bool partial = false; // a band of a long page, the rest of it follows
+    std::string title = ""; // chapter name, see Encoder::mark_page()
+};
 
 class Config {
     bool is_pdf_ = false;
     bool is_seq_ = false;
+    bool confirm_ = true;
+    bool verbose_ = true; // progress on stdout
+    bool i420_ = false; // slideshow frames are built as I420, set once the encoder is open
+    bool letterbox_ = true; // slideshow loaders hand over whole frames, not just the scaled page
     int width_ = 1280;
     int height_ = 720;
     float fps_ = 1;
     float spp_ = 1;
+    bool spp_set_ = false; // slideshows hold each page -s seconds only when asked
     float duration_ = 0;
+    int threads_ = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
     std::string style_ = FRAMES;
+    bool smooth_ = false;
+    std::string cache_dir_ = "";
+    int cache_mb_ = DEFAULT_CACHE_MB;
+    bool incremental_ = false;
+    int memory_mb_ = 0; // 0 = no limit
+    bool stats_ = false;
+    std::string trace_ = "";
+    std::string codec_ = H264;
+    int crf_ = -1;
+    std::string preset_ = "";
+    int encoder_threads_ = 0;
+    int gop_ = 0;
+    int segments_ = 1;
+    bool stream_ = false; // fragmented mp4, always when output_ is "-" (stdout)
+    std::vector<cv::Size> renditions_ = {}; // every -r resolution, the first is width_ x height_
     std::string output_ = "";
     std::string format_ = ".mp4";
     std::vector<std::string> pdf_paths_ = {};
     std::vector<std::string> seq_dirs_ = {};
+    std::vector<std::string> options_ = {}; // every option given, without their values
 
-    public:
-        Config(int argc, char **argv) {
-            if (argc < 2) {
-                std::cout << HELP_TXT << std::endl;
-                exit(1);
-            }
+    // value of the option at `i`, moves `i` onto it
+    static const std::string &next_arg(const std::vector<std::string> &args, size_t &i) {
+        if (i + 1 >= args.size()) {
+            throw ConfigError("<!> Missing value for '" + args[i] + "'.");
+        }
+        return args[++i];
+    }
 
-            // Update Default Settings
-            for (int i = 1; i < argc; i++) {
-                std::string arg = std::string(argv[i]);
-                if (arg == "-h" || arg == "--help") {
-                    std::cout << HELP_TXT << std::endl;
-                    exit(1);
+    // Update Default Settings, throws ConfigError on invalid input
+    void parse(const std::vector<std::string> &args) {
+        size_t i = 0;
+        try {
+            for (i = 0; i < args.size(); i++) {
+                std::string arg = args[i];
+                if (arg.size() > 1 && arg[0] == '-') {
+                    options_.push_back(arg);
+                }
+                if (arg == "-y" || arg == "--yes") {
+                    confirm_ = false;
                 } else if ((int)arg.find(".pdf") > -1) {
                     if (is_seq_) {
-                        std::cerr << "<!> Error: Cannot convert Image Sequence and PDF at the same time." << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Error: Cannot convert Image Sequence and PDF at the same time.");
                     } else {
                         is_pdf_ = true;
                     }
                     if (!std::filesystem::exists(arg)) {
-                        std::cerr << "<!> Error: '" << arg << "' does not exist." << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Error: '" + arg + "' does not exist.");
                     }
                     if (arg.substr(arg.length() - 4, 4) != ".pdf") {
-                        std::cout << "<!> Error: '" << arg << "' is not a PDF file." << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Error: '" + arg + "' is not a PDF file.");
                     }
                     pdf_paths_.push_back(arg);
                 } else if ((int)arg.find('/') > -1) {
                     if (is_pdf_) {
-                        std::cerr << "<!> Error: Cannot convert PDF and Image Sequence at the same time." << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Error: Cannot convert PDF and Image Sequence at the same time.");
                     } else {
                         is_seq_ = true;
                     }
                     if (!std::filesystem::is_directory(arg)) {
-                        std::cerr << "<!> Error: '" << arg <<  "' is not a valid directory." << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Error: '" + arg + "' is not a valid directory.");
                     }
                     if (arg[arg.length() - 1] != '/') {
                         arg.push_back('/');
                     }
                     seq_dirs_.push_back(arg);
                 } else if (arg == "-r") {
-                    i++;
-                    std::string currArg = std::string(argv[i]);
-                    if ((int)currArg.find('x') == -1) {
-                        std::cerr << "<!> Error: '" << argv[i] << "' is not valid input for '-r'. Correct: 0x0 or 1920x1080 or 0x720" << std::endl;
-                        exit(1);
-                    }
-                    if ((int)currArg.size() < 3) {
-                        std::cerr << "<!> Error: '" << argv[i] << "' is not valid input for '-r'. Correct: 0x0 or 1920x1080 or 0x720" << std::endl;
-                    }
-                    width_ = std::stoi(currArg.substr(0, currArg.find('x')));
-                    height_ = std::stoi(currArg.substr(currArg.find('x') + 1));
-                    set_width(width_);
-                    set_height(height_);
-                    if (width_ < 0 || height_ < 0) {
-                        std::cerr << "<!> Resolution input cannot be negative." << std::endl;
-                        exit(1);
+                    std::string list = next_arg(args, i);
+                    renditions_.clear();
+                    for (size_t start = 0; start <= list.size();) {
+                        size_t end = std::min(list.find(',', start), list.size());
+                        std::string currArg = list.substr(start, end - start);
+                        if ((int)currArg.find('x') == -1 || (int)currArg.size() < 3) {
+                            throw ConfigError("<!> Error: '" + currArg + "' is not valid input for '-r'. Correct: 0x0 or 1920x1080 or 0x720 or 1920x1080,1280x720");
+                        }
+                        set_width(std::stoi(currArg.substr(0, currArg.find('x'))));
+                        set_height(std::stoi(currArg.substr(currArg.find('x') + 1)));
+                        if (width_ < 0 || height_ < 0) {
+                            throw ConfigError("<!> Resolution input cannot be negative.");
+                        }
+                        renditions_.push_back(cv::Size(width_, height_));
+                        start = end + 1;
                     }
+                    if (renditions_.size() > 1) {
+                        for (const cv::Size &size : renditions_) {
+                            if (size.width == 0 || size.height == 0) {
+                                throw ConfigError("<!> Error: Resolutions in a list cannot be 0.");
+                            }
+                        }
+                    }
+                    width_ = renditions_[0].width;
+                    height_ = renditions_[0].height;
                 } else if (arg == "-f") {
-                    i++;
-                    fps_ = std::stof(argv[i]);
+                    fps_ = std::stof(next_arg(args, i));
                 } else if (arg == "-s") {
-                    i++;
-                    spp_ = std::stof(argv[i]);
+                    spp_ = std::stof(next_arg(args, i));
+                    spp_set_ = true;
                 } else if (arg == "-d") {
-                    i++;
-                    duration_ = std::stof(argv[i]);
+                    duration_ = std::stof(next_arg(args, i));
                 } else if (arg == "-o") {
-                    i++;
-                    arg = argv[i];
-                    if ((int)arg.find(format_) == -1) {
-                        std::cerr << "<!> Error: output file extension must be " + format_ << std::endl;
-                        exit(1);
-                    }
-                    if ((int)arg.find('/') == -1) {
-                        output_ = arg;
-                    } else {
+                    arg = next_arg(args, i);
+                    if (arg != "-" && (int)arg.find(format_) == -1) {
+                        throw ConfigError("<!> Error: output file extension must be " + format_);
+                    }
+                    if (arg != "-" && (int)arg.find('/') > -1) {
                         std::string dir = arg.substr(0, arg.find_last_of('/') + 1);
                         if (!std::filesystem::exists(dir)) {
-                            std::cout << "<!> Error: Output directory does not exists." << std::endl;
-                            exit(1);
+                            throw ConfigError("<!> Error: Output directory does not exists.");
                         }
                     }
                     output_ = arg;
                 } else if (arg == "-a") {
-                    i++;
-                    std::string a = std::string(argv[i]);
+                    std::string a = next_arg(args, i);
                     if (a != UP && a != DOWN && a != LEFT && a != RIGHT) {
-                        std::cerr << "<!> Invalid input for '-a'. Must be [Up|Down|Left|Right]" << std::endl;
-                        exit(1);
+                        throw ConfigError("<!> Invalid input for '-a'. Must be [Up|Down|Left|Right]");
                     }
                     style_ = a;
+                } else if (arg == "--smooth") {
+                    smooth_ = true;
+                } else if (arg == "--cache") {
+                    cache_dir_ = next_arg(args, i);
+                } else if (arg == "--segments") {
+                    segments_ = std::stoi(next_arg(args, i));
+                    if (segments_ < 1) {
+                        throw ConfigError("<!> Invalid input for '--segments'. Must be at least 1.");
+                    }
+                } else if (arg == "--memory") {
+                    memory_mb_ = std::stoi(next_arg(args, i));
+                    if (memory_mb_ < 1) {
+                        throw ConfigError("<!> Invalid input for '--memory'. Must be at least 1.");
+                    }
+                } else if (arg == "--stream") {
+                    stream_ = true;
+                } else if (arg == "--incremental") {
+                    incremental_ = true;
+                } else if (arg == "--stats") {
+                    stats_ = true;
+                } else if (arg == "--trace") {
+                    trace_ = next_arg(args, i);
+                } else if (arg == "--cache-size") {
+                    cache_mb_ = std::stoi(next_arg(args, i));
+                    if (cache_mb_ < 1) {
+                        throw ConfigError("<!> Invalid input for '--cache-size'. Must be at least 1.");
+                    }
+                } else if (arg == "-c") {
+                    std::string c = next_arg(args, i);
+                    if (c != H264 && c != H265 && c != AV1 && c != MPEG4) {
+                        throw ConfigError("<!> Invalid input for '-c'. Must be [h264|h265|av1|mpeg4]");
+                    }
+                    codec_ = c;
+                } else if (arg == "-q") {
+                    crf_ = std::stoi(next_arg(args, i));
+                    if (crf_ < 0) {
+                        throw ConfigError("<!> Invalid input for '-q'. Cannot be negative.");
+                    }
+                } else if (arg == "-p") {
+                    preset_ = next_arg(args, i);
+                } else if (arg == "-t") {
+                    encoder_threads_ = std::stoi(next_arg(args, i));
+                    if (encoder_threads_ < 0) {
+                        throw ConfigError("<!> Invalid input for '-t'. Cannot be negative.");
+                    }
+                } else if (arg == "-g") {
+                    gop_ = std::stoi(next_arg(args, i));
+                    if (gop_ < 0) {
+                        throw ConfigError("<!> Invalid input for '-g'. Cannot be negative.");
+                    }
+                } else if (arg == "-j") {
+                    threads_ = std::stoi(next_arg(args, i));
+                    if (threads_ < 1) {
+                        throw ConfigError("<!> Invalid input for '-j'. Must be at least 1.");
+                    }
                 } else {
-                    std::cerr << "<!> Unknown argument detected: " << argv[i] << std::endl;
-                    exit(1);
+                    throw ConfigError("<!> Unknown argument detected: " + arg);
                 }
             }
+        } catch (const std::logic_error &e) {
+            // std::stoi/std::stof
+            throw ConfigError("<!> Error: '" + args[i] + "' is not a valid number.");
+        }
 
-            if (pdf_paths_.size() < 1 && seq_dirs_.size() < 1) {
-                std::cerr << "<!> No pdf path or image sequence director was specified." << std::endl;
-                exit(1);
-            }
+        if (pdf_paths_.size() < 1 && seq_dirs_.size() < 1) {
+            throw ConfigError("<!> No pdf path or image sequence director was specified.");
+        }
 
-            // Print Current Settings
-            if (is_pdf_) {
-                std::cout << "PDF Paths (" << pdf_paths_.size() << "): ";
-                for (size_t i = 0; i < pdf_paths_.size(); i++) {
-                    if (i > 0) {
-                        std::cout << " + ";
-                    }
-                    std::cout << "" + pdf_paths_[i];
+        if (output_ == "" && is_seq_) {
+            std::string path = seq_dirs_[0];
+            output_ = path.substr(0, path.find_last_of('/')) + format_;
+        } else if (output_ == "" && is_pdf_) {
+            std::string path = pdf_paths_[0];
+            output_ = path.substr(0, path.find_last_of('.')) + format_;
+        }
+        if (output_ == "-") {
+            stream_ = true;
+        }
+    }
+
+    // Print Current Settings
+    void print() {
+        if (is_pdf_) {
+            std::cout << "PDF Paths (" << pdf_paths_.size() << "): ";
+            for (size_t i = 0; i < pdf_paths_.size(); i++) {
+                if (i > 0) {
+                    std::cout << " + ";
                 }
-            } else if (is_seq_) {
-                std::cout << "Sequence Directories (" << seq_dirs_.size() << "): ";
-                for (size_t i = 0; i < seq_dirs_.size(); i++) {
-                    if (i > 0) {
-                        std::cout << " + ";
-                    }
-                    std::cout << "" + seq_dirs_[i];
+                std::cout << "" + pdf_paths_[i];
+            }
+        } else if (is_seq_) {
+            std::cout << "Sequence Directories (" << seq_dirs_.size() << "): ";
+            for (size_t i = 0; i < seq_dirs_.size(); i++) {
+                if (i > 0) {
+                    std::cout << " + ";
                 }
+                std::cout << "" + seq_dirs_[i];
             }
-            std::cout << std::endl;
+        }
+        std::cout << std::endl;
 
-            if (output_ == "" && is_seq_) {
-                std::string path = seq_dirs_[0];
-                output_ = path.substr(0, path.find_last_of('/')) + format_;
-            } else if (output_ == "" && is_pdf_) {
-                std::string path = pdf_paths_[0];
-                output_ = path.substr(0, path.find_last_of('.')) + format_;
+        std::cout << "Output: " << (output_ == "-" ? "stdout" : output_) << (stream_ ? " (stream)" : "") << std::endl;
+        std::cout << "Resolution: " << width_ << "x" << height_;
+        for (size_t i = 1; i < renditions_.size(); i++) {
+            std::cout << ", " << renditions_[i].width << "x" << renditions_[i].height;
+        }
+        std::cout << std::endl;
+        std::cout << "FPS: " << fps_ << std::endl;
+        if (duration_ != 0 && style_ != FRAMES) {
+            std::cout << "Duration: " << duration_ << "s" << std::endl;
+        } else {
+            std::cout << "SPP: " << spp_ << std::endl;
+        }
+        std::cout << "Animated: " << style_ << (smooth_ && style_ != FRAMES ? " (smooth)" : "") << std::endl;
+        std::cout << "Threads: " << threads_ << std::endl;
+        if (cache_dir_ != "") {
+            std::cout << "Cache: " << cache_dir_ << " (" << cache_mb_ << "MB)" << std::endl;
+        }
+        if (memory_mb_ > 0) {
+            std::cout << "Memory: " << memory_mb_ << "MB" << std::endl;
+        }
+        if (incremental_) {
+            std::cout << "Incremental: " << (style_ == FRAMES ? "yes" : "no (slideshows only)") << std::endl;
+        }
+        std::cout << "Codec: " << codec_;
+        if (crf_ >= 0) {
+            std::cout << " crf=" << crf_;
+        }
+        if (preset_ != "") {
+            std::cout << " preset=" << preset_;
+        }
+        if (segments_ > 1) {
+            std::cout << " segments=" << segments_;
+        }
+        std::cout << std::endl;
+    }
+
+    public:
+        // command line: prints the settings and asks to confirm them, exits on invalid input
+        Config(int argc, char **argv) {
+            if (argc < 2) {
+                std::cout << HELP_TXT << std::endl;
+                exit(1);
             }
-            std::cout << "Output: " << output_ << std::endl;
-            std::cout << "Resolution: " << width_ << "x" << height_ << std::endl;
-            std::cout << "FPS: " << fps_ << std::endl;
-            if (duration_ != 0 && style_ == UP) {
-                std::cout << "Duration: " << duration_ << "s" << std::endl;
-            } else if (style_ == UP) {
-                std::cout << "SPP: " << spp_ << std::endl;
+            std::vector<std::string> args(argv + 1, argv + argc);
+            for (const std::string &arg : args) {
+                if (arg == "-h" || arg == "--help") {
+                    std::cout << HELP_TXT << std::endl;
+                    exit(1);
+                }
             }
-            std::cout << "Animated: " << style_ << std::endl;
+            try {
+                parse(args);
+            } catch (const ConfigError &e) {
+                std::cerr << e.what() << std::endl;
+                exit(1);
+            }
+            // the video goes to stdout, everything else to stderr
+            if (output_ == "-") {
+                std::cout.rdbuf(std::cerr.rdbuf());
+            }
+            print();
 
             // User Confirm Setttings
+            if (!confirm_) {
+                return;
+            }
             std::string check;
             std::cout << "Are these values correct: [Y/n]" << std::endl;
             std::getline(std::cin, check);
@@ -200,6 +387,15 @@ class Config {
             std::cin.clear();
         }
 
+        // batch job: same options as the command line, but nothing is printed
+        // or asked and invalid input throws ConfigError.
+        Config(const std::vector<std::string> &args) : confirm_(false), verbose_(false) {
+            parse(args);
+            if (output_ == "-") {
+                throw ConfigError("<!> Error: Batch jobs cannot write to stdout.");
+            }
+        }
+
         void set_resolution(cv::Mat img) {
             if (width_ == 0) {
                 set_width(img.cols);
@@ -209,6 +405,15 @@ class Config {
             }
         }
 
+        void set_resolution(cv::Size size) {
+            if (width_ == 0) {
+                set_width(size.width);
+            }
+            if (height_ == 0) {
+                set_height(size.height);
+            }
+        }
+
         void set_resolution(poppler::rectf rect) {
             if (width_ == 0) {
                 set_width(rect.width());
@@ -221,18 +426,50 @@ class Config {
         // Getters
         bool get_is_pdf() { return is_pdf_; }
         bool get_is_seq() { return is_seq_; }
+        bool get_verbose() { return verbose_; }
+        bool get_i420() { return i420_; }
+        bool get_letterbox() { return letterbox_; }
         int get_width() { return width_; }
         int get_height() { return height_; }
         float get_fps() { return fps_; }
         float get_spp() { return spp_; }
+        bool has_spp() { return spp_set_; }
         float get_duration() { return  duration_; }
+        int get_threads() { return threads_; }
         std::string get_style() { return style_; }
+        bool get_smooth() { return smooth_; }
+        std::string get_cache_dir() { return cache_dir_; }
+        int get_cache_mb() { return cache_mb_; }
+        bool get_incremental() { return incremental_; }
+        int get_memory_mb() { return memory_mb_; }
+        bool get_stats() { return stats_; }
+        std::string get_trace() { return trace_; }
+        bool is_horizontal() { return style_ == LEFT || style_ == RIGHT; } // scrolls Left or Right
+        std::string get_codec() { return codec_; }
+        int get_crf() { return crf_; }
+        std::string get_preset() { return preset_; }
+        int get_encoder_threads() { return encoder_threads_; }
+        int get_gop() { return gop_; }
+        int get_segments() { return segments_; }
+        bool get_stream() { return stream_; }
         std::string get_output() { return output_; }
+        // every -r resolution, just this one unless a list was given
+        std::vector<cv::Size> get_renditions() { return renditions_.size() > 1 ? renditions_ : std::vector<cv::Size>{cv::Size(width_, height_)}; }
+        // <output>_<width>x<height>.mp4, where each rendition of a list goes
+        std::string get_rendition_output(cv::Size size) {
+            std::string stem = output_.substr(0, output_.size() - format_.size());
+            return stem + "_" + std::to_string(size.width) + "x" + std::to_string(size.height) + format_;
+        }
         std::string get_format() { return format_; }
         std::vector<std::string> get_pdf_paths() { return pdf_paths_; }
         std::vector<std::string> get_seq_dirs() { return seq_dirs_; }
+        std::vector<std::string> get_options() { return options_; }
 
         // Setters
+        void set_i420(bool i420) { i420_ = i420; }
+        void set_letterbox(bool letterbox) { letterbox_ = letterbox; }
+        void set_output(const std::string &output) { output_ = output; }
+        void set_cache_dir(const std::string &cache_dir) { cache_dir_ = cache_dir; }
         void set_width(int w) { width_ = w % 2 == 0 ? w : w + 1; }
         void set_height(int h) { height_ = h % 2 == 0 ? h : h + 1; }
 };
@@ -0,0 +1,101 @@
+#ifndef PTV_QUEUE_HPP
+#define PTV_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <optional>
+
+namespace ptv {
+
+// Fixed-depth blocking queue that hands pages from the loaders to the
+// video generator. Peak memory is bound by the depth, not the page count.
+//
+// Items carry a sequence number and come out of pop() in that order, so
+// several workers can fill it out of order. A worker reserves its sequence
+// number first, which keeps it from running more than `depth` items ahead
+// of the consumer.
+template <typename T>
+class BoundedQueue {
+    size_t depth_;
+    size_t next_ = 0;   // next sequence number handed out by pop()
+    size_t pushed_ = 0; // sequence numbers used by push()
+    bool closed_ = false;
+    std::map<size_t, std::optional<T>> slots_; // empty optional = skipped
+    std::mutex mutex_;
+    std::condition_variable has_room_;
+    std::condition_variable has_next_;
+
+    public:
+        BoundedQueue(size_t depth) : depth_(depth > 0 ? depth : 1) {}
+
+        // blocks until `seq` fits in the window.
+        // returns false if the queue was closed.
+        bool reserve(size_t seq) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_room_.wait(lock, [&] { return closed_ || seq < next_ + depth_; });
+            return !closed_;
+        }
+
+        // stores a reserved item.
+        void put(size_t seq, T item) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[seq] = std::move(item);
+            has_next_.notify_all();
+        }
+
+        // marks a reserved sequence number as having no item (ex. failed page).
+        void skip(size_t seq) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[seq] = std::nullopt;
+            has_next_.notify_all();
+        }
+
+        // in-order push for a single producer.
+        // returns false if the queue was closed and the item was dropped.
+        bool push(T item) {
+            size_t seq = pushed_++;
+            if (!reserve(seq)) {
+                return false;
+            }
+            put(seq, std::move(item));
+            return true;
+        }
+
+        // blocks until the next item in sequence is available.
+        // returns false once the queue is closed and drained.
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true) {
+                has_next_.wait(lock, [this] { return closed_ || slots_.count(next_) > 0; });
+                auto it = slots_.begin();
+                if (it == slots_.end()) {
+                    return false;
+                }
+                // once closed, nothing else will arrive so gaps are passed over
+                if (it->first != next_ && !closed_) {
+                    continue;
+                }
+                next_ = it->first + 1;
+                std::optional<T> slot = std::move(it->second);
+                slots_.erase(it);
+                has_room_.notify_all();
+                if (slot) {
+                    item = std::move(*slot);
+                    return true;
+                }
+            }
+        }
+
+        // wakes up both sides. producers stop, consumers drain what is left.
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            has_room_.notify_all();
+            has_next_.notify_all();
+        }
+};
+
+}
+#endif
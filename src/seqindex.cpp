@@ -0,0 +1,306 @@
+#include "seqindex.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace ptv {
+
+#define SEQ_INDEX_MAGIC "ptv-index 1"
+#define SEQ_PROBE_BATCH 256 // headers read per pool task
+
+bool natural_less(const std::string &a, const std::string &b) {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (!std::isdigit((unsigned char)a[i]) || !std::isdigit((unsigned char)b[j])) {
+            if (a[i] != b[j]) {
+                return (unsigned char)a[i] < (unsigned char)b[j];
+            }
+            i++;
+            j++;
+            continue;
+        }
+        // leading zeros do not count, then the longer run is the bigger number
+        size_t zi = i;
+        size_t zj = j;
+        while (i < a.size() && a[i] == '0') {
+            i++;
+        }
+        while (j < b.size() && b[j] == '0') {
+            j++;
+        }
+        size_t si = i;
+        size_t sj = j;
+        while (i < a.size() && std::isdigit((unsigned char)a[i])) {
+            i++;
+        }
+        while (j < b.size() && std::isdigit((unsigned char)b[j])) {
+            j++;
+        }
+        if (i - si != j - sj) {
+            return i - si < j - sj;
+        }
+        int cmp = a.compare(si, i - si, b, sj, j - sj);
+        if (cmp != 0) {
+            return cmp < 0;
+        }
+        if (si - zi != sj - zj) {
+            return si - zi < sj - zj;
+        }
+    }
+    return a.size() - i < b.size() - j;
+}
+
+// returns true and sets `size` if the file is a png or jpeg with a readable header.
+// much cheaper than decoding when only the dimensions are needed.
+// `gray` is set if the file has no color channels.
+bool get_image_size(const std::string &path, cv::Size &size, bool *gray) {
+    std::ifstream file(path, std::ios::binary);
+    uint8_t sig[8];
+    if (!file.read((char *)sig, 8)) {
+        return false;
+    }
+    auto be16 = [](const uint8_t *b) { return (b[0] << 8) | b[1]; };
+    auto be32 = [](const uint8_t *b) { return (int)(((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3]); };
+
+    // png: signature, then the IHDR chunk holds width and height
+    static const uint8_t png_sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (std::equal(sig, sig + 8, png_sig)) {
+        uint8_t ihdr[18];
+        if (!file.read((char *)ihdr, 18) || std::string((char *)ihdr + 4, 4) != "IHDR") {
+            return false;
+        }
+        size = cv::Size(be32(ihdr + 8), be32(ihdr + 12));
+        if (gray != nullptr) {
+            *gray = ihdr[17] == 0 || ihdr[17] == 4; // gray, gray + alpha
+        }
+        return size.width > 0 && size.height > 0;
+    }
+
+    // jpeg: walks the markers up to the start of frame
+    if (sig[0] != 0xFF || sig[1] != 0xD8) {
+        return false;
+    }
+    file.seekg(2);
+    uint8_t b[7];
+    while (file.read((char *)b, 2)) {
+        if (b[0] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = b[1];
+        if (marker == 0xFF) {
+            file.seekg(-1, std::ios::cur); // fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            continue; // no length
+        }
+        if (!file.read((char *)b, 2)) {
+            return false;
+        }
+        int len = be16(b);
+        bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (sof) {
+            if (!file.read((char *)b, 6)) {
+                return false;
+            }
+            size = cv::Size(be16(b + 3), be16(b + 1));
+            if (gray != nullptr) {
+                *gray = b[5] == 1; // one component
+            }
+            return size.width > 0 && size.height > 0;
+        }
+        file.seekg(len - 2, std::ios::cur);
+    }
+    return false;
+}
+
+// last run of digits in the file name (extension left out), -1 if there is none
+int64_t get_file_number(const std::string &name) {
+    std::string stem = fs::path(name).stem().string();
+    size_t end = stem.find_last_of("0123456789");
+    if (end == std::string::npos) {
+        return -1;
+    }
+    size_t start = stem.find_last_not_of("0123456789", end);
+    start = start == std::string::npos ? 0 : start + 1;
+    std::string digits = stem.substr(start, end + 1 - start);
+    if (digits.size() > 18) {
+        digits = digits.substr(digits.size() - 18); // fits int64_t
+    }
+    return std::stoll(digits);
+}
+
+int64_t get_dir_time(const std::string &dir) {
+    std::error_code err;
+    auto time = fs::last_write_time(dir, err);
+    return err ? -1 : (int64_t)time.time_since_epoch().count();
+}
+
+// where a directory's index is kept in the cache: "<cache>/<hash of the path>.seq"
+std::string get_index_path(const std::string &cache_dir, const std::string &dir) {
+    std::error_code err;
+    std::string abs = fs::absolute(dir, err).lexically_normal().string();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : abs) {
+        hash = (hash ^ (uint8_t)c) * 0x100000001b3ULL;
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%016llx.seq", (unsigned long long)hash);
+    return (fs::path(cache_dir) / buf).string();
+}
+
+// A text file:
+//
+//     ptv-index 1
+//     time <directory's modified time>
+//     <width> <height> <gray> <number> <file name>
+//     ...
+bool load_dir_index(const std::string &path, const std::string &dir, int64_t time, std::vector<SeqImage> &images) {
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != SEQ_INDEX_MAGIC) {
+        return false;
+    }
+    std::string tag;
+    int64_t saved = -1;
+    if (!std::getline(file, line) || !(std::istringstream(line) >> tag >> saved) || tag != "time" || saved != time) {
+        return false;
+    }
+    images.clear();
+    while (std::getline(file, line)) {
+        std::istringstream in(line);
+        SeqImage img;
+        int gray = 0;
+        std::string name;
+        if (!(in >> img.size.width >> img.size.height >> gray >> img.number) || !std::getline(in >> std::ws, name)) {
+            images.clear();
+            return false;
+        }
+        img.gray = gray != 0;
+        img.path = dir + name;
+        images.push_back(img);
+    }
+    return true;
+}
+
+// written under a temporary name and renamed, like the manifest
+bool save_dir_index(const std::string &path, int64_t time, const std::vector<SeqImage> &images) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp);
+        file << SEQ_INDEX_MAGIC << "\n";
+        file << "time " << time << "\n";
+        for (const SeqImage &img : images) {
+            file << img.size.width << " " << img.size.height << " " << (img.gray ? 1 : 0) << " " << img.number << " "
+                 << fs::path(img.path).filename().string() << "\n";
+        }
+        if (!file) {
+            std::error_code err;
+            fs::remove(tmp, err);
+            return false;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp, path, err);
+    return !err;
+}
+
+// the images of one directory in natural order, headers not read yet
+std::vector<SeqImage> list_dir(const std::string &dir) {
+    std::vector<SeqImage> images;
+    std::error_code err;
+    for (const auto &entry : fs::directory_iterator(dir, err)) {
+        std::string name = entry.path().filename().string();
+        std::error_code type_err;
+        if (name.empty() || name[0] == '.' || entry.is_directory(type_err)) {
+            continue;
+        }
+        SeqImage img;
+        img.number = get_file_number(name);
+        if (img.number < 0) {
+            std::cerr << "<!> Warning: " << name << " skipped. Number not found." << std::endl;
+            continue;
+        }
+        img.path = entry.path().string();
+        images.push_back(img);
+    }
+    if (err) {
+        std::cerr << "<!> Warning: Could not list '" << dir << "': " << err.message() << std::endl;
+    }
+    // every path shares the directory, so the file names decide
+    std::sort(images.begin(), images.end(), [](const SeqImage &a, const SeqImage &b) { return natural_less(a.path, b.path); });
+    return images;
+}
+
+SeqIndex SeqIndex::build(const std::vector<std::string> &dirs, ThreadPool &pool, const std::string &cache_dir) {
+    bool persist = cache_dir != "";
+    if (persist) {
+        std::error_code err;
+        fs::create_directories(cache_dir, err);
+    }
+    std::vector<std::string> index_paths(dirs.size());
+    std::vector<std::vector<SeqImage>> parts(dirs.size());
+    std::vector<int64_t> times(dirs.size(), -1);
+    std::vector<char> reused(dirs.size(), 0);
+
+    // one listing per directory
+    WaitGroup listing;
+    for (size_t d = 0; d < dirs.size(); d++) {
+        listing.add();
+        pool.submit([&, d] {
+            times[d] = get_dir_time(dirs[d]);
+            index_paths[d] = persist ? get_index_path(cache_dir, dirs[d]) : "";
+            if (persist && times[d] >= 0 && load_dir_index(index_paths[d], dirs[d], times[d], parts[d])) {
+                reused[d] = 1;
+            } else {
+                parts[d] = list_dir(dirs[d]);
+            }
+            listing.done();
+        });
+    }
+    listing.wait();
+
+    // headers, SEQ_PROBE_BATCH files per task
+    WaitGroup probing;
+    for (size_t d = 0; d < dirs.size(); d++) {
+        if (reused[d]) {
+            continue;
+        }
+        for (size_t start = 0; start < parts[d].size(); start += SEQ_PROBE_BATCH) {
+            probing.add();
+            pool.submit([&parts, &probing, d, start] {
+                size_t end = std::min(start + SEQ_PROBE_BATCH, parts[d].size());
+                for (size_t i = start; i < end; i++) {
+                    SeqImage &img = parts[d][i];
+                    if (!get_image_size(img.path, img.size, &img.gray)) {
+                        img.size = cv::Size();
+                    }
+                }
+                probing.done();
+            });
+        }
+    }
+    probing.wait();
+
+    SeqIndex index;
+    for (size_t d = 0; d < dirs.size(); d++) {
+        if (persist && !reused[d] && times[d] >= 0 && !save_dir_index(index_paths[d], times[d], parts[d])) {
+            std::cerr << "<!> Warning: Could not write '" << index_paths[d] << "'." << std::endl;
+        }
+        for (size_t i = 1; i < parts[d].size(); i++) {
+            int64_t step = parts[d][i].number - parts[d][i - 1].number;
+            index.gaps += step > 1 ? step - 1 : 0;
+        }
+        index.images.insert(index.images.end(), parts[d].begin(), parts[d].end());
+    }
+    return index;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef PTV_SEQINDEX_HPP
+#define PTV_SEQINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "opencv.hpp"
+#include "pool.hpp"
+
+namespace ptv {
+
+// one image of a sequence
+struct SeqImage {
+    std::string path = "";
+    int64_t number = -1;    // last number in the file name, -1 if there is none
+    cv::Size size;          // from the file's header, empty if it could not be read
+    bool gray = false;      // no color channels
+};
+
+// Images of the sequence directories in playback order: directories in
+// the order given, files in natural order within each ("img2" before
+// "img10"). Hidden files and files without a number are left out.
+//
+// Directories are listed in parallel, and each image's header is read on
+// the thread pool (png IHDR, jpeg SOF) for its size, so nothing is
+// decoded before the first frame. Numbers that skip ahead within a
+// directory are counted as gaps.
+//
+// With a `cache_dir` (--cache), each directory's part is saved there and
+// reused while the directory's modified time is unchanged (no file added,
+// removed or renamed), so reruns on slow storage skip the listing and the
+// headers. Files rewritten in place are not noticed.
+class SeqIndex {
+    public:
+        std::vector<SeqImage> images = {};
+        size_t gaps = 0; // numbers missing between images of a directory
+
+        static SeqIndex build(const std::vector<std::string> &dirs, ThreadPool &pool, const std::string &cache_dir = "");
+
+        bool empty() const { return images.empty(); }
+        size_t size() const { return images.size(); }
+};
+
+// "img2" < "img10": digit runs compare by value, the rest byte by byte
+bool natural_less(const std::string &a, const std::string &b);
+
+// size (and whether it is gray) from a png or jpeg header, false for other files
+bool get_image_size(const std::string &path, cv::Size &size, bool *gray = nullptr);
+
+}
+#endif
@@ -0,0 +1,62 @@
+#include "stats.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace ptv {
+
+void Stats::report(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // stages in the order they first ran
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<int64_t>> durations;
+    std::map<std::string, size_t> bytes;
+    for (const Sample &s : samples_) {
+        if (durations.count(s.stage) == 0) {
+            order.push_back(s.stage);
+        }
+        durations[s.stage].push_back(s.dur_ns);
+        bytes[s.stage] += s.bytes;
+    }
+
+    out << std::left << std::setw(14) << "Stage" << std::right
+        << std::setw(10) << "Count" << std::setw(12) << "Total ms"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(12) << "MB" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const std::string &stage : order) {
+        std::vector<int64_t> &d = durations[stage];
+        std::sort(d.begin(), d.end());
+        int64_t total = 0;
+        for (int64_t ns : d) {
+            total += ns;
+        }
+        size_t p99 = std::min(d.size() - 1, d.size() * 99 / 100);
+        out << std::left << std::setw(14) << stage << std::right
+            << std::setw(10) << d.size()
+            << std::setw(12) << total / 1e6
+            << std::setw(10) << d[d.size() / 2] / 1e6
+            << std::setw(10) << d[p99] / 1e6
+            << std::setw(12) << bytes[stage] / (double)(1 << 20) << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+bool Stats::write_trace(const std::string &path) {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    file << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < samples_.size(); i++) {
+        const Sample &s = samples_[i];
+        file << "{\"name\":\"" << s.stage << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << s.tid
+             << ",\"ts\":" << s.start_us << ",\"dur\":" << std::max<int64_t>(1, s.dur_ns / 1000)
+             << ",\"args\":{\"bytes\":" << s.bytes << "}}" << (i + 1 < samples_.size() ? "," : "") << "\n";
+    }
+    file << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+    return (bool)file;
+}
+
+}
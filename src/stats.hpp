@@ -0,0 +1,94 @@
+#ifndef PTV_STATS_HPP
+#define PTV_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ptv {
+
+// Per-stage timings for --stats and --trace.
+//
+// Stages are timed with a ScopedTimer around the work (one page render, one
+// frame write, ...), never per pixel. While nothing is enabled a timer is a
+// single relaxed load, so the timers stay in release builds.
+class Stats {
+    struct Sample {
+        const char *stage;
+        uint32_t tid;
+        int64_t start_us; // since Stats was enabled
+        int64_t dur_ns;
+        size_t bytes;
+    };
+
+    std::atomic<bool> enabled_{false};
+    std::chrono::steady_clock::time_point epoch_;
+    std::vector<Sample> samples_;
+    std::map<std::thread::id, uint32_t> tids_;
+    std::mutex mutex_;
+
+    public:
+        static Stats &get() {
+            static Stats stats;
+            return stats;
+        }
+
+        void enable() {
+            epoch_ = std::chrono::steady_clock::now();
+            enabled_.store(true, std::memory_order_relaxed);
+        }
+
+        bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+        void record(const char *stage, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, size_t bytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto id = tids_.emplace(std::this_thread::get_id(), (uint32_t)tids_.size() + 1).first->second;
+            int64_t start_us = std::chrono::duration_cast<std::chrono::microseconds>(start - epoch_).count();
+            int64_t dur_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            samples_.push_back(Sample{stage, id, start_us, dur_ns, bytes});
+        }
+
+        // per-stage count, total, p50/p99 and bytes
+        void report(std::ostream &out);
+
+        // Chrome trace_event JSON, open in chrome://tracing or ui.perfetto.dev
+        bool write_trace(const std::string &path);
+};
+
+// Times its scope as one sample of `stage`. `stage` must outlive the run
+// (a string literal).
+class ScopedTimer {
+    const char *stage_;
+    size_t bytes_ = 0;
+    bool on_;
+    std::chrono::steady_clock::time_point start_;
+
+    public:
+        ScopedTimer(const char *stage) : stage_(stage), on_(Stats::get().enabled()) {
+            if (on_) {
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~ScopedTimer() {
+            if (on_) {
+                Stats::get().record(stage_, start_, std::chrono::steady_clock::now(), bytes_);
+            }
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        // bytes read or written by this sample
+        void add_bytes(size_t bytes) { bytes_ += bytes; }
+};
+
+}
+#endif
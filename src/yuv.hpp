@@ -0,0 +1,201 @@
+#ifndef PTV_YUV_HPP
+#define PTV_YUV_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "blend.hpp"
+#include "opencv.hpp"
+
+namespace ptv {
+
+// Builds a whole I420 video frame from a page in one pass: bilinear
+// scaling, centering, black borders and BGR to YUV 4:2:0 (BT.601, limited
+// range, what swscale and OpenCV use). Only two source rows at a time are
+// kept around, so the page is read once and the frame written once, a
+// third of the bytes of a BGR frame.
+//
+// Rows are scaled vertically with blend_span() (SSE2/AVX2), then resampled
+// horizontally into 16 bit B, G and R rows, which the luma kernel converts
+// 16 pixels at a time. Chroma averages each 2x2 block.
+//
+// The source may be BGR or BGRA (poppler's argb32), the alpha is ignored.
+// Gray sources (CV_8UC1, see gray.hpp) only resample one channel, their
+// chroma is flat.
+
+#define YUV_BLACK_Y 16
+#define YUV_BLACK_UV 128
+
+inline void bgr_to_y_scalar(const uint16_t *b, const uint16_t *g, const uint16_t *r, uint8_t *y, int n) {
+    for (int i = 0; i < n; i++) {
+        y[i] = (uint8_t)(((66 * r[i] + 129 * g[i] + 25 * b[i] + 128) >> 8) + 16);
+    }
+}
+
+#ifdef PTV_BLEND_X86
+__attribute__((target("sse2")))
+inline void bgr_to_y_sse2(const uint16_t *b, const uint16_t *g, const uint16_t *r, uint8_t *y, int n) {
+    // the largest sum is 56228, so unsigned 16 bit lanes do not overflow
+    const __m128i kr = _mm_set1_epi16(66);
+    const __m128i kg = _mm_set1_epi16(129);
+    const __m128i kb = _mm_set1_epi16(25);
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i off = _mm_set1_epi16(16);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i out[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i vr = _mm_loadu_si128((const __m128i *)(r + i + 8 * k));
+            __m128i vg = _mm_loadu_si128((const __m128i *)(g + i + 8 * k));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i + 8 * k));
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(vr, kr), _mm_mullo_epi16(vg, kg)),
+                                        _mm_add_epi16(_mm_mullo_epi16(vb, kb), half));
+            out[k] = _mm_add_epi16(_mm_srli_epi16(sum, 8), off);
+        }
+        _mm_storeu_si128((__m128i *)(y + i), _mm_packus_epi16(out[0], out[1]));
+    }
+    bgr_to_y_scalar(b + i, g + i, r + i, y + i, n - i);
+}
+#endif
+
+inline void bgr_to_y(const uint16_t *b, const uint16_t *g, const uint16_t *r, uint8_t *y, int n) {
+#ifdef PTV_BLEND_X86
+    static const bool sse2 = __builtin_cpu_supports("sse2");
+    if (sse2) {
+        bgr_to_y_sse2(b, g, r, y, n);
+        return;
+    }
+#endif
+    bgr_to_y_scalar(b, g, r, y, n);
+}
+
+// luma of a gray pixel, bgr_to_y() with b = g = r
+inline uint8_t gray_to_y(int g) {
+    return (uint8_t)(((220 * g + 128) >> 8) + 16);
+}
+
+// where a `size` page sits in an I420 frame, offsets and size kept even for chroma
+inline cv::Rect2i get_i420_roi(cv::Size size, int width, int height) {
+    int w = std::min(width, size.width + (size.width & 1));
+    int h = std::min(height, size.height + (size.height & 1));
+    w -= w & 1;
+    h -= h & 1;
+    return cv::Rect2i(((width - w) / 2) & ~1, ((height - h) / 2) & ~1, w, h);
+}
+
+// Scales `src` (CV_8UC1, CV_8UC3 or CV_8UC4) to `size` and letterboxes it into a
+// width x height I420 frame. `yuv` is (re)allocated as CV_8UC1 with
+// height * 3 / 2 rows, the layout Encoder::write_i420() takes.
+inline void letterbox_to_i420(const cv::Mat &src, cv::Size size, cv::Mat &yuv, int width, int height) {
+    yuv.create(height * 3 / 2, width, CV_8UC1);
+    uint8_t *y_plane = yuv.data;
+    uint8_t *u_plane = y_plane + (size_t)width * height;
+    uint8_t *v_plane = u_plane + (size_t)(width / 2) * (height / 2);
+    int cw = width / 2;
+
+    cv::Rect2i roi = get_i420_roi(size, width, height);
+    if (roi.width == 0 || roi.height == 0 || src.empty()) {
+        std::memset(y_plane, YUV_BLACK_Y, (size_t)width * height);
+        std::memset(u_plane, YUV_BLACK_UV, (size_t)cw * height);
+        return;
+    }
+
+    // borders
+    for (int r = 0; r < height; r++) {
+        uint8_t *row = y_plane + (size_t)r * width;
+        if (r < roi.y || r >= roi.y + roi.height) {
+            std::memset(row, YUV_BLACK_Y, width);
+        } else {
+            std::memset(row, YUV_BLACK_Y, roi.x);
+            std::memset(row + roi.x + roi.width, YUV_BLACK_Y, width - roi.x - roi.width);
+        }
+    }
+    int cn = src.channels();
+    if (cn == 1) {
+        std::memset(u_plane, YUV_BLACK_UV, (size_t)cw * height);
+    }
+    for (int r = 0; r < height / 2 && cn != 1; r++) {
+        for (uint8_t *plane : {u_plane, v_plane}) {
+            uint8_t *row = plane + (size_t)r * cw;
+            if (r < roi.y / 2 || r >= (roi.y + roi.height) / 2) {
+                std::memset(row, YUV_BLACK_UV, cw);
+            } else {
+                std::memset(row, YUV_BLACK_UV, roi.x / 2);
+                std::memset(row + (roi.x + roi.width) / 2, YUV_BLACK_UV, cw - (roi.x + roi.width) / 2);
+            }
+        }
+    }
+
+    // bilinear sample positions, pixel centers line up like cv::INTER_LINEAR
+    auto sample = [](int out, int out_len, int in_len, int &i0, int &i1, int &w) {
+        float f = ((float)out + 0.5f) * in_len / out_len - 0.5f;
+        f = std::min(std::max(f, 0.0f), (float)(in_len - 1));
+        i0 = (int)f;
+        i1 = std::min(i0 + 1, in_len - 1);
+        w = (int)std::lround((f - i0) * 256.0f);
+    };
+    std::vector<int> x0(roi.width), x1(roi.width), wx(roi.width);
+    for (int i = 0; i < roi.width; i++) {
+        sample(i, roi.width, src.cols, x0[i], x1[i], wx[i]);
+        x0[i] *= cn;
+        x1[i] *= cn;
+    }
+
+    size_t line_bytes = (size_t)src.cols * cn;
+    std::vector<uint8_t> line(line_bytes);
+    std::vector<uint16_t> bgr(6 * (size_t)roi.width); // B, G, R rows for the two rows of a chroma block
+    for (int oy = 0; oy < roi.height; oy += 2) {
+        uint16_t *planes[2][3];
+        for (int k = 0; k < 2; k++) {
+            int y0, y1, wy;
+            sample(oy + k, roi.height, src.rows, y0, y1, wy);
+            const uint8_t *row = src.ptr(y0);
+            if (wy != 0) {
+                blend_span(src.ptr(y0), src.ptr(y1), line.data(), line_bytes, wy);
+                row = line.data();
+            }
+            uint16_t *b = bgr.data() + (size_t)(3 * k) * roi.width;
+            uint16_t *g = b + roi.width;
+            uint16_t *r = g + roi.width;
+            if (cn == 1) {
+                for (int i = 0; i < roi.width; i++) {
+                    g[i] = (uint16_t)((row[x0[i]] * (256 - wx[i]) + row[x1[i]] * wx[i] + 128) >> 8);
+                }
+                bgr_to_y(g, g, g, y_plane + (size_t)(roi.y + oy + k) * width + roi.x, roi.width);
+                continue;
+            }
+            for (int i = 0; i < roi.width; i++) {
+                const uint8_t *p0 = row + x0[i];
+                const uint8_t *p1 = row + x1[i];
+                int w1 = wx[i];
+                int w0 = 256 - w1;
+                b[i] = (uint16_t)((p0[0] * w0 + p1[0] * w1 + 128) >> 8);
+                g[i] = (uint16_t)((p0[1] * w0 + p1[1] * w1 + 128) >> 8);
+                r[i] = (uint16_t)((p0[2] * w0 + p1[2] * w1 + 128) >> 8);
+            }
+            bgr_to_y(b, g, r, y_plane + (size_t)(roi.y + oy + k) * width + roi.x, roi.width);
+            planes[k][0] = b;
+            planes[k][1] = g;
+            planes[k][2] = r;
+        }
+
+        if (cn == 1) {
+            continue;
+        }
+        uint8_t *u = u_plane + (size_t)((roi.y + oy) / 2) * cw + roi.x / 2;
+        uint8_t *v = v_plane + (size_t)((roi.y + oy) / 2) * cw + roi.x / 2;
+        for (int i = 0; i < roi.width / 2; i++) {
+            int c[3];
+            for (int ch = 0; ch < 3; ch++) {
+                c[ch] = (planes[0][ch][2 * i] + planes[0][ch][2 * i + 1] + planes[1][ch][2 * i] + planes[1][ch][2 * i + 1] + 2) >> 2;
+            }
+            u[i] = (uint8_t)(((-38 * c[2] - 74 * c[1] + 112 * c[0] + 128) >> 8) + 128);
+            v[i] = (uint8_t)(((112 * c[2] - 94 * c[1] - 18 * c[0] + 128) >> 8) + 128);
+        }
+    }
+}
+
+}
+#endif